@@ -12,6 +12,7 @@ defer errorISR
 -1 , -1 ,                               \ space for CRC and LENGTH
 
 1 equ options                           \ use HW mul/div
+64 equ name-cache                       \ RAM cache for FIND, 8 bytes/entry
 include ../../forth/core.f
 : pause ;  \ include ../../forth/tasker.f \ no multitasker
 include ../../forth/timing.f
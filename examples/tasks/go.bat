@@ -0,0 +1 @@
+"../../bin/tiff" -f main.f
@@ -0,0 +1,56 @@
+﻿\ Preemptive multitasking example
+
+\ Two background tasks count in loops that never PAUSE. The time-slice
+\ interrupt switches tasks, so each one gets a share of the CPU.
+
+defer coldboot
+defer safemode
+defer errorISR
+-1 , -1 ,                               \ space for CRC and LENGTH
+defer timerISR                          \ time-slice interrupt, see tasker.f
+
+1 equ options                           \ use HW mul/div
+include ../../forth/core.f
+include ../../forth/tasker.f            \ compiles the preemptive timerISR
+include ../../forth/timing.f
+include ../../forth/numio.f             \ numeric I/O
+
+	: throw  \ n --  				    \ for testing, remove later
+	?dup if  port drop  			    \ save n in dbg register, like error interrupt
+		8 >r						    \ fake an error interrupt
+	then
+	; call-only
+
+	:noname
+	cr ." Error " dup port . ." at PC=" r> .
+	." Line# " w_linenum w@ .	cr
+	-1 @  								\ produce an error to quit
+	; is errorISR
+
+variable count1
+variable count2
+128 buffer: task1                       \ 32 bytes of user area, 48-byte stacks
+128 buffer: task2
+
+: counter  \ a --                       \ count forever, never pause
+   begin  1 over +!  again
+;
+: start  \ --
+   0 count1 !  0 count2 !
+   32 48 48 task1 alsotask  task1 activate  count1 counter
+;
+: start2  \ --
+   32 48 48 task2 alsotask  task2 activate  count2 counter
+;
+: run  \ n --                           \ busy terminal task, also never pauses
+   0 do loop
+;
+
+start start2
+1000 timeslice  ei                      \ interrupt every 1000 cycles
+100000 run
+di  0 timeslice
+task1 sleep  task2 sleep                \ PAUSE in `.` would never return
+cr .( Task 1 counted ) count1 ?
+cr .( Task 2 counted ) count2 ?
+tasks
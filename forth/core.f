@@ -4,20 +4,22 @@
 -1 equ true                             \ 6.2.2298
 32 equ bl                               \ 6.1.0770
 
-: -             invert 1+ + ; macro     \ replace "-" opcode
+\ Words that can be experimental opcodes (see XOP in tiff) are only defined
+\ if they are still undefined.
+[undefined] - [if]       : -  invert 1+ + ; macro  [then]  \ replace "-" opcode
 : !                 !+ drop ; macro     \ 6.1.0010  x addr --
 : c!               c!+ drop ; macro     \ 6.1.0850  c addr --
 : w!               w!+ drop ; macro     \           w addr --
 : +!        dup >r @ + r> ! ;           \ 6.1.0130  x addr --
 : c+!     dup >r c@ + r> c! ;           \           c addr --
-: negate          invert 1+ ; macro     \ 6.1.1910  n -- -n
-: 1-       invert 1+ invert ; macro     \ 6.1.0300  n -- n-1
+[undefined] negate [if]  : negate  invert 1+ ; macro  [then]  \ 6.1.1910  n -- -n
+[undefined] 1- [if]      : 1-  invert 1+ invert ; macro  [then]  \ 6.1.0300  n -- n-1
 : cell- invert cell+ invert ; macro     \           n -- n-4
 : cells               2* 2* ; macro     \ 6.1.0890  n -- n*4
 : rot       >r swap r> swap ; macro     \ 6.1.2160  n m x -- m x n
 : -rot      swap >r swap r> ; macro     \           n m x -- x n m
 : tuck            swap over ; macro     \ 6.2.2300  ab -- bab
-: nip             swap drop ; macro     \ 6.2.1930  ab -- b
+[undefined] nip [if]     : nip  swap drop ; macro  [then]  \ 6.2.1930  ab -- b
 : 2>r        swap r> swap >r swap >r >r \ 6.2.0340
 ; call-only
 : 2r>        r> r> swap r> swap >r swap \ 6.2.0410
@@ -33,15 +35,15 @@
 : s>d   dup -if: dup xor invert exit |  \ 6.1.2170  n -- d
         dup xor ;
 : not                    0= ; macro     \           x -- f
-: =                  xor 0= ; macro     \ 6.1.0530  x y -- f
-: <>              xor 0= 0= ; macro     \ 6.2.0500  x y -- f
-: 0<>                 0= 0= ; macro     \ 6.2.0260  x y -- f
+[undefined] = [if]       : =  xor 0= ; macro  [then]    \ 6.1.0530  x y -- f
+[undefined] <> [if]      : <>  xor 0= 0= ; macro  [then]  \ 6.2.0500  x y -- f
+[undefined] 0<> [if]     : 0<>  0= 0= ; macro  [then]   \ 6.2.0260  x y -- f
 : 0>              negate 0< ; macro     \ 6.2.0280  n -- f
 : aligned   1+ 1+ 1+ -4 and ;           \ 6.1.0706  n -- n'
 : 2@         @+ swap @ swap ;           \ 6.1.0350  a -- n2 n1
 : 2!             !+ !+ drop ; macro     \ 6.1.0310  n2 n1 a --
 : abs         |-if negate | ;           \ 6.1.0690  n -- u
-: or    invert swap invert and invert ; \ 6.1.1980  n m -- n|m
+[undefined] or [if]      : or  invert swap invert and invert ;  [then]  \ 6.1.1980  n m -- n|m
 : execute                >r ;           \ 6.1.1370  xt --
 : d+     >r >r swap r> +  swap r> c+ ;  \ 8.6.1.1040  d1 d2 -- d3
 : dnegate                               \ 8.6.1.1230  d -- -d
@@ -189,6 +191,12 @@ options 8 and [if]                      \ loose ANS compliance
    | u2/ -rept nop swap drop ;
 ;
 
+\ Fused user functions take T and N and return both. `3 user` sets the divisor.
+options 2 and [if]
+: um*     10 user ;                     \ 6.1.2360  u1 u2 -- ud
+: *       10 user drop ;                \ 6.1.0090  n1 n2 -- n3
+: um/mod  3 user drop  12 user ;        \ 6.1.2370  ud u -- ur uq
+[else]
 options 1 and [if]
 : um*  \ u1 u2 -- ud                    \ 6.1.2360
    5 user ( u1 low )  swap  3 user
@@ -233,11 +241,16 @@ options 1 and [if]
     drop drop dup xor  dup 1-           \ overflow = 0 -1
 ;
 [then]
+[then]
 
+options 2 and [if]
+: sm/rem  3 user drop  13 user ;        \ 6.1.2214  d n -- rem quot
+[else]
 : sm/rem  \ d n -- rem quot             \ 6.1.2214
    2dup xor >r  over >r  abs >r dabs r> um/mod
    swap r> 0< if  negate  then
    swap r> 0< if  negate  then ;
+[then]
 
 : fm/mod  \ d n -- rem quot             \ 6.1.1561
    dup >r  2dup xor >r  dup >r  abs >r dabs r> um/mod
@@ -268,6 +281,11 @@ options 1 and [if]
 
 : /string >r swap r@ + swap r> - ;      \ 17.6.1.0245  a u -- a+1 u-1
 : within  over - >r - r> u< ;           \ 6.2.2440  u ulo uhi -- flag
+options 2 and [if]
+: m*     11 user ;                      \ 6.1.1810  n1 n2 -- d
+: */mod  3 user drop  14 user ;         \ 6.1.0110  n1 n2 n3 -- remainder n1*n2/n3
+: */     3 user drop  14 user nip ;     \ 6.1.0100  n1 n2 n3 -- n1*n2/n3
+[else]
 : m*                                    \ 6.1.1810  n1 n2 -- d
     2dup xor 0< >r
     abs swap abs um*
@@ -275,6 +293,7 @@ options 1 and [if]
 ;
 : */mod  >r m* r> m/mod ;               \ 6.1.0110  n1 n2 n3 -- remainder n1*n2/n3
 : */     */mod swap drop ;              \ 6.1.0100  n1 n2 n3 -- n1*n2/n3
+[then]
 : bye    1 user begin again ;           \ 15.6.2.0830  exit to OS if there is one
 
 hex
@@ -17,12 +17,19 @@
 \   ^------------CURRENT @
 \ | 1+ | counted name string ...
 
+\ With hashed threads, the new header links to the head of its name's thread.
+\ The WID always points to the last header, which `last` uses.
+
+: thread-head  \ -- a                   \ where PAD's header is linked
+   [ pad 17 + ] literal  [ pad 16 + ] literal c@ 31 and
+   current @ thread  nip nip
+;
 : header[  \ <name> xte xtc --          \ populate PAD with header data
    pad |pad| -1 fill                    \ default fields (starting with FID) are blank
-   [ pad 4 + ] literal !+ !+
-   current @ @ swap !+                  \ add xtc, xte, link
-   >r parse-name dup r> c!+             \ store length
+   [ pad 4 + ] literal !+ !+  >r        \ add xtc, xte
+   parse-name dup r> 4 + c!+            \ store length
    swap cmove                           \ and string
+   thread-head @  [ pad 12 + ] literal !  \ add link
    c_fileid c@ [ pad 3 + ] literal c!   \ file ID
    w_linenum c@+  >r c@ r>              \ hi lo
    [ pad 7 + ] literal c!
@@ -32,8 +39,10 @@
    pad  dup
    16 + c@ 31 and  1+ aligned  16 + >r
    hp @  r@  ROMmove                    \ write to flash
-   hp @ 12 + current @ !                \ add to current definitions
-   r> hp +!
+   hp @ 12 +  dup current @ !           \ add to current definitions
+   thread-head !                        \ and to its thread
+   [ pad 17 + ] literal  [ pad 16 + ] literal c@ 31 and
+   nc-forget  r> nc-allot               \ it may hide a cached name
 ;
 : flags!  \ c --                        \ change flags (from 0)
    [ pad 16 + ] literal c+!
@@ -68,6 +77,7 @@ hex
    ,exit  NewGroup
    4 last c@  20 and if                 \ smudge bit is set?
       20 clr-flagbits                   \ clear it
+      5 last  4 last c@ 1F and nc-forget \ now findable
    then
    c_colondef c@ if                     \ wid
       0 c_colondef c!
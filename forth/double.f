@@ -46,11 +46,13 @@ decimal
 
 : m+    s>d d+ ;                        \ 8.6.1.1830
 
+options 2 and 0= [if]                   \ core.f's fused m* is faster
 : m*                                    \ 8.6.1.1820
     2dup xor >r
     abs swap abs um*
     r> 0< if dnegate then
 ;
+[then]
 
 \ From Wil Baden's "FPH Popular Extensions"
 \ http://www.wilbaden.com/neil_bawd/fphpop.txt
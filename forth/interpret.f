@@ -68,6 +68,7 @@
 \ `c_casesens` is the case-sensitive flag
 \ `match` checks two strings for mismatch and keeps the first string
 \ `_hfind` searches one wordlist for the string
+\ `thread` picks the thread to search when headers use hashed threads
 
 : match  \ a1 n1 a2 n2 -- a1 n1 0 | nonzero
    third over xor 0=                    \ n2 <> n1
@@ -85,8 +86,21 @@
    r> 1+ +until
    3drop r> drop r> 1+                  \ flag is n1+1
 ;
+hash-threads [if]
+\ A wordlist is the last header followed by the heads of its threads.
+\ The hash must match HashThread in tiff's accessvm.c.
+: thread  \ addr len wid -- addr len a  \ head of the name's thread
+   >r  2dup + 1- c@ toupper             \ last char
+   third c@ toupper +  over +           \ + first char + length
+   [ hash-threads 1- ] literal and
+   1+ cells  r> +
+;
+[else]
+: thread ; macro  \ addr len wid -- addr len wid
+[then]
+
 : _hfind  \ addr len wid -- addr len 0 | ht    Search one wordlist
-   @ over 31 u> -19 and throw           \ name too long
+   thread @ over 31 u> -19 and throw    \ name too long
    over ifz: dup xor exit |             \ addr 0 0   zero length string
    begin
       dup >r cell+ c@+  63 and          \ addr len 'name length | wid
@@ -96,7 +110,7 @@
       r> link>
    dup 0= until                         \ not found
 ;
-: hfind  \ addr len -- addr len | 0 ht  \ search the search order
+: hsearch  \ addr len -- addr len | 0 ht  \ search the search order
    c_wids c@ begin
       1- |-if 2drop exit |              \ finished, not found
       >r
@@ -107,6 +121,64 @@
       r> dup
    again
 ;
+
+[defined] name-cache [if]
+\ Headers in SPI flash take several flash reads each to search.
+\ The name cache is `name-cache` (a power of 2) RAM entries of hash and ht,
+\ filled by successful searches. A hit is checked with `match`.
+\ New headers clear their name's entry, `set-order` clears all of them.
+\ Headers added by tiff change `hp` behind our back, which also clears all.
+
+name-cache 2* cells buffer: nc_table
+variable nc_hp                          \ hp when the cache was last valid
+variable nc_hits
+variable nc_misses
+
+: nc-clear  \ --                        \ empty the cache
+   nc_table [ name-cache 2* cells ] literal erase
+   hp @ nc_hp !
+;
+: nc_hash  \ addr len -- u              \ case-insensitive name hash
+   negate >r  0 swap  r>
+   begin >r                             \ hash addr | -n
+      c@+ toupper  rot                  \ addr' c hash
+      dup 2* 2* 2* 2* 2* +  +  swap     \ hash*33 + c
+   r> 1+ +until  drop drop
+;
+: nc_entry  \ hash -- a
+   [ name-cache 1- ] literal and  2* cells  nc_table +
+;
+: nc-forget  \ addr len --              \ a header with this name is new
+   nc_hash nc_entry  cell+ 0 swap !
+;
+: nc-allot  \ n --                      \ header space that keeps the cache
+   dup nc_hp +!  hp +!
+;
+: nc_find  \ addr len -- addr len 0 | ht
+   hp @ nc_hp @ xor if  nc-clear  then
+   2dup nc_hash  dup nc_entry @+        \ addr len hash a' key
+   rot xor if  dup xor exit  then  @    \ addr len ht
+   dup ifz: exit |                      \ empty entry
+   dup >r cell+ c@+  63 and
+   match if
+      r> exit
+   then  r> dup xor                     \ addr len 0   the name differs
+;
+: hfind  \ addr len -- addr len | 0 ht  \ search the search order
+   nc_find ?dup if
+      1 nc_hits +!  0 swap exit
+   then  1 nc_misses +!
+   2dup nc_hash >r  hsearch             \ addr len | 0 ht
+   over if  r> drop exit  then
+   r> dup nc_entry !+  over swap !      \ remember where it was found
+;
+[else]
+: nc-clear ; macro  \ --
+: nc-forget  2drop ; macro  \ addr len --
+: nc-allot  hp +! ;  \ n --
+: hfind  hsearch ;  \ addr len -- addr len | 0 ht
+[then]
+
 : CaseInsensitive  0 c_casesens c! ;
 : CaseSensitive    1 c_casesens c! ;
 
@@ -2,8 +2,9 @@
 
 hex
 : _wordlist  \ addr u -- wid            \ optional string for vocabularies
-   dp dup >r @ dup cell+ r> !  >r       \ get a wid ( addr u wid )
-   0 r@ !                               \ clear the wid
+   [ hash-threads 1+ cells ] literal    \ the wid and its threads
+   dp dup >r @ tuck + r> !  >r          \ get a wid ( addr u wid )
+   r@ [ hash-threads 1+ cells ] literal erase  \ clear the wid
    12345678 ,h                          \ name tag
    dup if  r@ 1000000 - ,h              \ set upper byte to FFh
       dup c,h  negate                   \ compile name: count
@@ -42,7 +43,8 @@ decimal
 ;
 : set-order  \ widn .. wid1 n --        \ 16.6.1.2197  set search order
    dup 0< if  drop forth-wordlist 1  then
-   dup c_wids c!  0 ?do  i cells context + !  loop ;
+   dup c_wids c!  0 ?do  i cells context + !  loop
+   nc-clear ;                           \ cached names may be out of order
 
 : set-current  current ! ;   \ wid --   \ 16.6.1.2195
 : get-current  current @ ;   \ -- wid   \ 16.6.1.1643
@@ -62,6 +64,12 @@ decimal
    ."  Context: "    context  c_wids c@ 0 ?do  @+ .wid  loop  drop
    cr ."  Current: " current @ .wid  cr
 ;
+[defined] name-cache [if]
+: .name-cache  \ --                     \ name cache hits and misses
+   ."  Name cache hits: " nc_hits @ u.  ." misses: " nc_misses @ u.
+   0 nc_hits !  0 nc_misses !  cr
+;
+[then]
 
 \ WORDS takes an optional substring
 
@@ -76,7 +84,7 @@ decimal
    3drop  dup xor                       \ 0 if no match
 ;
 
-: _words  \ ak uk wid -- ak uk          \ display one wordlist
+: _thread  \ ak uk wid -- ak uk         \ display one thread
    @ begin
       dup >r cell+ count                ( ak uk c-addr flags|u )
       dup >r 31 and                     \ mask off flags
@@ -88,8 +96,17 @@ decimal
       else r> drop  2drop
       then
       r> link>
-   dup 0= until  drop  cr               \ example: context @ @ _words
+   dup 0= until  drop
+;
+hash-threads [if]
+: _words  \ ak uk wid -- ak uk          \ display one wordlist
+   hash-threads for
+      cell+  dup >r  dup @ if  _thread  else  drop  then  r>
+   next  drop  cr
 ;
+[else]
+: _words  _thread cr ;  \ ak uk wid -- ak uk  \ example: context @ _words
+[then]
 : words  \ <name> --                    \ 15.6.1.2465
    parse-name
    c_wids c@ begin  1-  +while
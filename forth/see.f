@@ -15,6 +15,7 @@ cp @ equ opnames
    cp @ aligned cp !
 
 : opname  \ opcode -- c-addr u			\ type opcode name string
+   pad over 16 user  ?dup if  rot drop exit  then  drop  \ experimental opcode
    opnames  begin over while
       count +  ( cnt a )  swap 1- swap
    repeat  nip count
@@ -47,11 +48,24 @@ ram
       swap link> swap
    over 0= until swap
 ;
+hash-threads [if]
+: _wxtname  \ wid xt -- a a | xt 0      \ search each thread of a wordlist
+   swap  hash-threads
+   begin  1- +while                     ( xt wid n )
+      2dup 1+ cells + link>             ( xt wid n head )
+      dup if
+         fourth _xtname  if  >r 3drop r> dup exit  then
+      then  drop
+   repeat  2drop 0
+;
+[else]
+: _wxtname  swap link> swap _xtname ;  \ wid xt -- a a | xt 0
+[then]
 : xtname  \ xt -- addr u | xt 0         \ search in all wordlists
    c_wids c@
    begin dup while 1- dup >r
-      cells context + @ link> ( wid )
-      over _xtname  if
+      cells context + @ ( wid )
+      over _wxtname  if
          r> drop swap drop
          count 31 and  exit
       then  drop
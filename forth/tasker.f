@@ -1,7 +1,6 @@
 \ Cooperative Multitasker for 2-register TOS.
 
-\ Only pause has been tested: doesn't crash when just the terminal is in the loop.
-\ Not much of a test.
+\ Tested in Tiff with background tasks, both cooperative and preemptive.
 
 \ PAUSE's TCB (task control block) structure
 \ Cells| _Name___ | __Description____________________ |
@@ -14,20 +13,36 @@
 \   s  | data     | data stack, grows downward        |
 \   r  | return   | return stack, grows downward      |
 
+\ Preemptive switching is compiled if the app has `defer timerISR` at the
+\ time-slice vector, cell 5. Tiff's TIMESLICE starts the interrupt.
+\ PAUSE disables interrupts so that switching is atomic. WAKE enables them
+\ once the new task's stacks are in place. The interrupt disables them.
+
+[defined] timerISR [if]
+: di      0 15 user drop ;              \ --      disable interrupts
+: ei     -1 15 user drop ;              \ --      enable interrupts
+[else]
+: di ; macro
+: ei ; macro
+[then]
+
+\ A paused task's stack holds its RP above the two cells that were in T and N.
+\ TOS points to the RP.
+
 :noname  cell+ @ dup @ >r               \ rp rp status -- rp rp status'
 ; equ pass
-:noname  up! tos @ sp!  drop rp!
+:noname  up! tos @ sp!  drop drop rp!  ei
 ; equ wake
 
 status follower !                    	\ put terminal in task list
 wake status !                        	\ let it run by itself
 
-\ pause takes 30 cycles with only the terminal task active
+\ pause takes 37 cycles with only the terminal task active, 56 if preemptive
 
 : pause                                 \ --
-   0 rp  dup  4 sp tos !                \       N  T
+   di  0 rp  dup dup  4 sp tos !        \       N  T
    follower @ dup @ >r                  \ -- rp rp follower
-;                                       \     ^---------tos
+;                                       \  ^---------tos
 
 : local   status - + ;   \ tid a -- a'  \ index another task's local variable
 : stop    pass status ! pause ;         \ --       sleep current task
@@ -38,21 +53,32 @@ wake status !                        	\ let it run by itself
 \ u includes user variables, so it should be at least 20.
 
 : onlytask      \ u s r tid --          \ put first task in the queue
-   dup up!  dup follower !              \ task points to itself
+   dup dup follower local !             \ task points to itself
    dup >r swap >r
-   + + r> over +  follower cell+ 2!     \ rp0 ! sp0 ! \ clear the stacks
+   + + r> over +                        \ ( sp0 rp0 )
+   r@ follower local cell+ 2!           \ rp0 ! sp0 ! \ clear the stacks
    r> sleep
 ;
 : alsotask      \ u s r tid --          \ add task to queue
-   follower @ over follower !           \ link new task
-   >r onlytask r> follower !            \ link old task
+   dup >r onlytask
+   follower @  r@ follower local !      \ link new task
+   r> follower !                        \ link old task
 ;
 : activate      \ tid -- | ra 'start -- ra
-\ tos=sp0 -> dstack=rp0 -> rstack='start
+\ tos=sp0-12 -> rp0-4 -> 'start
    dup cell+ cell+                      \ point to rp0 sp0
-   @+ 4 - swap @ 4 -                    \ ( tid rp sp ) each stack will contain 1 item
+   @+ 4 - swap @ 12 -                   \ ( tid rp sp ) leave room for T and N
    swap r> over !                       \ save entry at rp, skip all after activate
    over !                               \ save rp at sp, save stack context for wake
    over tos local !                     \ save sp in tos
    awake
 ;
+
+[defined] timerISR [if]
+\ The interrupted PC is on the return stack. The task may be between two
+\ groups that pass the carry, so it's saved and restored around the switch.
+:noname
+   0 0 c+ >r  pause                     \ R: pc -- pc carry
+   r> -1 + drop                         \ restore the carry
+; is timerISR
+[then]
@@ -0,0 +1,39 @@
+\ Fixed-point benchmark for */ and friends
+
+\ DSP-style Forth scales almost every product, so */ dominates its inner loops.
+\ Load this after the kernel, for example at the end of examples/ANS/main.f:
+\    include ../../forth/test/muldiv.fs
+\ Compare `options` 1 (mul/div in several user calls) with `options` 3 (fused
+\ user functions) or 0 (software). The results must match. In tiff, `stats`
+\ before and after `muldiv-bench` shows the VM clock cycles.
+
+decimal
+65536 constant q1                       \ Q16: 1.0 is 65536
+411 constant qstep                      \ 2*pi/1000 in Q16
+
+: oscillate  \ n -- c s                 \ magic circle, period ~1000 steps
+   >r  q1 0  r> 0 ?do                   \ cos sin
+      dup qstep q1 */  rot swap -       \ sin cos'
+      dup qstep q1 */  rot +            \ cos' sin'
+   loop
+;
+: lowpass  \ n -- y                     \ one-pole filter stepping to 1000.0
+   >r  0  r> 0 ?do                      \ y
+      [ 1000 q1 * ] literal  over -     \ y x-y
+      6554 q1 */ +                      \ y + (x-y)*0.1
+   loop
+;
+: scale  \ n -- x                       \ q1 */mod and sm/rem round trip
+   >r  12345  r> 0 ?do
+      7 q1 */mod  q1 m*  rot s>d d+  7 sm/rem nip
+   loop
+;
+: .ticks  \ t0 --                       \ elapsed COUNTER ticks as ms
+   counter swap -  1000 32768 */  . ." ms"
+;
+: muldiv-bench  \ --
+   cr ." oscillate: "  counter  10000 oscillate  swap . . .ticks
+   cr ." lowpass:   "  counter  10000 lowpass  . .ticks
+   cr ." scale:     "  counter  10000 scale  . .ticks
+;
+muldiv-bench
@@ -0,0 +1,23 @@
+\ Name cache tests
+
+\ A cache entry is trusted only when the header's name matches. Load this after
+\ ttester.fs in a kernel that defines `name-cache`, for example at the end of
+\ examples/ANS/main.f:
+\    include ../../forth/test/namecache.fs
+
+decimal
+CaseInsensitive
+T{ s" dup" hfind drop -> 0 }T           \ found, and now cached
+T{ s" dup" hfind drop -> 0 }T           \ hit
+T{ s" DUP" hfind drop -> 0 }T           \ hit, any case
+
+\ Case-sensitive search shares the cache entry of "dup", but the name differs.
+: nc-Dup  CaseSensitive  s" Dup" hfind  CaseInsensitive ;
+T{ nc-Dup nip -> 3 }T                   \ not found
+
+\ Fake a hash collision: point the entry for "xyzzy" at the header of `dup`.
+: nc-collide  \ --
+   s" dup" hfind nip  s" xyzzy" nc_hash  dup nc_entry !+ !
+;
+T{ nc-collide s" xyzzy" hfind nip -> 5 }T   \ not found
+nc-clear
@@ -93,11 +93,41 @@ void StoreString(char *s, int32_t address){
 ////////////////////////////////////////////////////////////////////////////////
 // Dictionary Traversal Words
 
+// A wordlist's WID is a RAM cell pointing to its last header. With hashed
+// threads, it's followed by the heads of HashThreads threads and each header
+// links to the previous one in the same thread. Forth's `thread` in
+// interpret.f must use the same hash.
+
+int HashThread(char *name) {            // thread number of a name
+#if HashThreads
+    int length = strlen(name);
+    if (!length) return 0;
+    return (length + toupper((uint8_t)name[0])
+         + toupper((uint8_t)name[length-1])) & (HashThreads-1);
+#else
+    return 0;
+#endif
+}
+
+uint32_t ThreadHead(uint32_t wid, int thread) {  // address of a thread's head
+#if HashThreads
+    return wid + 4 + thread*4;
+#else
+    return wid;
+#endif
+}
+
 // Search the thread whose head pointer is at WID. Return ht if found, 0 if not.
+// Its flash reads are charged to STATS, like the target's own search.
 uint32_t SearchWordlist(char *name, uint32_t WID) {
     unsigned int length = strlen(name);
     if (length>31) tiffIOR = -19;
-    do {
+#ifdef TRACEABLE
+    int timed = FlashTimed;
+    FlashTimed = 1;
+#endif // TRACEABLE
+    while (WID) {
+        uint32_t link = FetchCell(WID) & 0xFFFFFF;  // link then name, like SPI
         int len = FetchByte(WID + 4) & ~0xC0;      // mask off jumpok and public
         if (len == length) {                  // likely candidate: lengths match
             int i = 0;                                 // starting index in name
@@ -111,11 +141,14 @@ uint32_t SearchWordlist(char *name, uint32_t WID) {
                 }
                 if (c1 != c2) goto next;
             }
-            return WID;
+            break;
         }
-next:   WID = FetchCell(WID) & 0xFFFFFF;
-    } while (WID);
-    return 0;
+next:   WID = link;
+    }
+#ifdef TRACEABLE
+    FlashTimed = timed;
+#endif // TRACEABLE
+    return WID;
 }
 
 static char str[33];
@@ -128,7 +161,7 @@ uint32_t iword_FIND (void) {  // ( addr len -- addr len | 0 ht )
     while (wids--) {
         uint32_t wid = FetchCell(CONTEXT + wids*4);  // search the first list
         FetchString(str, addr, length);
-        uint32_t ht = SearchWordlist(str, FetchCell(wid));
+        uint32_t ht = SearchWordlist(str, FetchCell(ThreadHead(wid, HashThread(str))));
         if (ht) {
             PushNum(0);
             PushNum(ht);
@@ -145,7 +178,7 @@ uint32_t WordFind (char *name) {        // a more C-friendly version}
     uint8_t wids = FetchByte(WIDS);
     while (wids--) {
         uint32_t wid = FetchCell(CONTEXT + wids*4);  // search the first list
-        uint32_t ht = SearchWordlist(name, FetchCell(wid));
+        uint32_t ht = SearchWordlist(name, FetchCell(ThreadHead(wid, HashThread(name))));
         if (ht) {
             return ht;
         }
@@ -155,7 +188,7 @@ uint32_t WordFind (char *name) {        // a more C-friendly version}
 
 // Look up the name of a definition from its address (xte)
 char *GetXtNameWID(uint32_t WID, uint32_t xt) {
-    do {
+    while (WID) {
         uint32_t xte = FetchCell(WID - 4) & 0xFFFFFF;
 /*      if (xte = 0xFFFFFF) {
             return ("blank_xte")
@@ -167,7 +200,7 @@ char *GetXtNameWID(uint32_t WID, uint32_t xt) {
             return str;
         }
         WID = FetchCell(WID) & 0xFFFFFF;
-    } while (WID);
+    }
     return NULL;
 }
 
@@ -175,9 +208,10 @@ char *GetXtName(uint32_t xt) {
     uint8_t wids = FetchByte(WIDS);  char *name;
     while (wids--) {
         uint32_t wid = FetchCell(CONTEXT + wids * 4);  // search the first list
-        wid = FetchCell(wid);
-        name = GetXtNameWID(wid, xt);
-        if (name != NULL) return name;
+        for (int i=0; i<WordlistThreads; i++) {
+            name = GetXtNameWID(FetchCell(ThreadHead(wid, i)), xt);
+            if (name != NULL) return name;
+        }
     } return NULL;
 }
 
@@ -185,7 +219,7 @@ char *GetXtName(uint32_t xt) {
 // This uses WriteROM, which is host-only (doesn't work on flash) so there's
 // no ReplaceXTWID equivalent in the target Forth.
 void ReplaceXTWID(uint32_t WID, uint32_t OldXt, uint32_t NewXt) {
-    do {
+    while (WID) {
         uint32_t xte = FetchCell(WID - 4);
         uint32_t xtc = FetchCell(WID - 8);
         if (((xte ^ OldXt) & 0xFFFFFF) == 0) {
@@ -197,7 +231,7 @@ void ReplaceXTWID(uint32_t WID, uint32_t OldXt, uint32_t NewXt) {
             WriteROM(xtc, WID - 8);
         }
         WID = FetchCell(WID) & 0xFFFFFF;
-    } while (WID);
+    }
 }
 void ReplaceXTs(void) {  // ( newXT oldXT -- )
     uint32_t OldXt = PopNum();
@@ -205,8 +239,9 @@ void ReplaceXTs(void) {  // ( newXT oldXT -- )
     uint8_t wids = FetchByte(WIDS);
     while (wids--) {
         uint32_t wid = FetchCell(CONTEXT + wids * 4);  // search the first list
-        wid = FetchCell(wid);
-        ReplaceXTWID(wid, OldXt, NewXt);
+        for (int i=0; i<WordlistThreads; i++) {
+            ReplaceXTWID(FetchCell(ThreadHead(wid, i)), OldXt, NewXt);
+        }
     }
 }
 
@@ -249,6 +284,29 @@ void StoreROM (uint32_t data, uint32_t address) {
     }
 }
 
+// Bulk StoreROM for image loaders: the block may span ROM and flash.
+
+void StoreROMs (const uint32_t *src, uint32_t address, int cells) {
+    if (address & 3) {
+        tiffIOR = -23;
+        return;
+    }
+    int ior = 0;
+    uint32_t addr = address >> 2;
+    if (addr < ROMsize) {
+        int n = ROMsize - addr;         // cells that fit in internal ROM
+        if (n > cells) n = cells;
+        ior = ProgramROM(src, address, n);
+        src += n;  address += n*4;  cells -= n;
+    }
+    if (cells && !ior) {
+        ior = FlashProgram(src, address, cells);
+    }
+    if (ior) {
+        tiffIOR = ior;
+    }
+}
+
 void CommaC (uint32_t x) {  // append a word to code space
     uint32_t cp = FetchCell(CP);
     StoreROM(x, cp);
@@ -325,14 +383,41 @@ struct StateChange {
     int32_t ID;
     uint32_t Old;
     uint32_t New;
+    uint32_t Seq;               // sequence number, never reused
+    uint32_t Prev;              // index of previous change to the same ID
+    uint32_t PrevSeq;           // its sequence number, 0 if none
 };
 
 // Let the compiler manage large static arrays instead of malloc etc.
 struct StateChange StateChanges[1<<TraceDepth];
 
+// Per-ID index into the trace: The newest change to each RAM cell or register
+// heads a chain of older changes to the same ID. A link is only good if the
+// sequence number still matches, so entries lost to wraparound end the chain.
+
+struct TraceHead {
+    uint32_t idx;
+    uint32_t seq;
+};
+static struct TraceHead TraceHeads[MaxRAMsize + 16];
+static uint32_t uSeq;           // next sequence number
+
+static struct TraceHead * HeadOf(int32_t ID) {
+    if (ID < 0) {
+        return &TraceHeads[MaxRAMsize + (~ID & 15)];   // register
+    }
+    return &TraceHeads[ID & (MaxRAMsize-1)];            // RAM cell
+}
+
+static void WipeTrace(void) {   // forget all history
+    uHead = 0;  uTail = 0;  uHere = 0;
+    uSeq = 1;
+    memset(TraceHeads, 0, sizeof(TraceHeads));
+}
+
 void CreateTrace(void) {        // allocate memory for the trace buffer
     uMask = (1<<TraceDepth) - 1;               // AND with indices
-    uHead = 0;  uTail = 0;  uHere = 0;
+    WipeTrace();
 }
 
 void DestroyTrace(void) {       // free memory for the trace buffer
@@ -350,15 +435,27 @@ void Trace(unsigned int Type, int32_t ID, uint32_t Old, uint32_t New){
     uint32_t idx;
     if (Tracing) {
         if ((Old != New) || (Type)){    // skip states that didn't actually change
-            uHead = uHere;
+            while (uHead != uHere) {    // discard redo history from the index
+                uHead = (uHead-1) & uMask;
+                struct StateChange *sc = &StateChanges[uHead];
+                struct TraceHead *h = HeadOf(sc->ID);
+                if (h->seq == sc->Seq) {
+                    h->idx = sc->Prev;  h->seq = sc->PrevSeq;
+                }
+            }
             if (TraceElements() == uMask) { // is it topped out?
                 uTail = (uTail+1) & uMask;  // drop the oldest point
             }
             idx = uHead & uMask;
+            struct TraceHead *h = HeadOf(ID);
             StateChanges[idx].Type = (uint8_t) Type;
             StateChanges[idx].ID = ID;
             StateChanges[idx].Old = Old;
             StateChanges[idx].New = New;
+            StateChanges[idx].Seq = uSeq;
+            StateChanges[idx].Prev = h->idx;
+            StateChanges[idx].PrevSeq = h->seq;
+            h->idx = idx;  h->seq = uSeq++;
             uHead = (uHead + 1) & uMask;
             uHere = uHead;              // keep the pointer current
         }
@@ -370,6 +467,24 @@ void Trace(unsigned int Type, int32_t ID, uint32_t Old, uint32_t New){
 // Redo restores instruction groups without moving head.
 // If you execute a group, any history forward of uHere is discarded.
 
+// Co-simulation asks which RAM cells a group changed.
+uint32_t TraceMark(void) {              // position of the next change
+    return uHere;
+}
+// The count may exceed max, only the first max cells are returned.
+int TraceRAMchanges(uint32_t mark, uint32_t *ra, int max) {
+    int n = 0;
+    while (mark != uHead) {
+        int32_t ID = StateChanges[mark].ID;
+        if (ID >= 0) {                  // positive IDs are RAM cells
+            if (n < max) ra[n] = ID;
+            n++;
+        }
+        mark = (mark + 1) & uMask;
+    }
+    return n;
+}
+
 // Undo one instruction, ior=0 if okay, 1 if end reached.
 int UndoTrace(void) {
     int32_t ID;  int Type;
@@ -396,6 +511,120 @@ int RedoTrace(void) {
     }
 }
 
+// Reverse execution uses the per-ID index to find the newest change to a RAM
+// cell or register that can still be undone, skipping any redo history.
+// Returns its trace index, or -1 if there is none.
+
+static int InRange(uint32_t idx, uint32_t end) {  // idx in [uTail, end)?
+    return ((idx - uTail) & uMask) < ((end - uTail) & uMask);
+}
+
+static int LastChange(int32_t ID) {
+    struct TraceHead *h = HeadOf(ID);
+    uint32_t idx = h->idx;
+    uint32_t seq = h->seq;
+    while (seq) {
+        struct StateChange *sc = &StateChanges[idx];
+        if ((sc->Seq != seq) || (sc->ID != ID) || !InRange(idx, uHead)) {
+            return -1;                  // fell off the end of history
+        }
+        if (InRange(idx, uHere)) return idx;
+        idx = sc->Prev;                 // in redo history, keep looking
+        seq = sc->PrevSeq;
+    }
+    return -1;
+}
+
+// Undo until the group that last changed ID is undone, ior=1 if not found.
+// The PC is left pointing at the culprit.
+int ReverseToChange(int32_t ID) {
+    int idx = LastChange(ID);
+    if (idx < 0) return 1;
+    while (InRange(idx, uHere)) {
+        if (UndoTrace()) return 1;
+    }
+    return 0;
+}
+
+// Watch target: 0 to 7 selects a register (T N RP SP UP PC DBG CY),
+// anything else is a RAM byte address.
+static int32_t WatchID(uint32_t param) {
+    if (param < 8) return ~param;
+    return (param >> 2) & (RAMsize-1);
+}
+
+//---------------------------------------------------------
+// Data breakpoints: Watchpoints are set in the VM, conditions are kept here.
+// A condition compares a register (as seen by RegRead) against a value.
+// It breaks when it becomes true, not again until it has been false.
+
+#define MaxBreakConds 8
+
+struct BreakCond {
+    int reg;                            // 0..5 = T N RP SP UP PC
+    int cond;                           // 0 =, 1 <>, 2 u<, 3 u>
+    uint32_t value;
+    int was;                            // it held at the last check
+};
+static struct BreakCond BreakConds[MaxBreakConds];
+static int BreakCondCount;
+static char BreakReason[80];            // why the last break happened
+
+static const char *CondName[4] = {"=", "<>", "u<", "u>"};
+static const char *BreakRegName[6] = {"T", "N", "RP", "SP", "UP", "PC"};
+
+static int CondHolds(struct BreakCond *bc) {
+    uint32_t x = RegRead(bc->reg);
+    switch (bc->cond) {
+        case 0:  return (x == bc->value);
+        case 1:  return (x != bc->value);
+        case 2:  return (x < bc->value);
+        default: return (x > bc->value);
+    }
+}
+
+// Add a condition, ior=1 if there's no room for it.
+int AddBreakCond(uint32_t value, int reg, int cond) {
+    if ((BreakCondCount == MaxBreakConds) || ((unsigned)reg > 5)
+     || ((unsigned)cond > 3)) return 1;
+    struct BreakCond *bc = &BreakConds[BreakCondCount];
+    bc->reg = reg;
+    bc->cond = cond;
+    bc->value = value;
+    bc->was = CondHolds(bc);            // already true: wait for the next time
+    BreakCondCount++;
+    return 0;
+}
+
+void ClearBreaks(void) {                // clear watchpoints and conditions
+    BreakCondCount = 0;
+    BreakReason[0] = 0;
+    ClearWatches();
+}
+
+// Check after each VMstep. Returns TRUE if a watchpoint was hit or a
+// condition became true, with the reason in BreakReason.
+int DataBreak(void) {
+    if (WatchType) {
+        snprintf(BreakReason, 80, "Watchpoint: %s at %X",
+                 (WatchType == 1) ? "read" : "write", WatchAddr);
+        WatchType = 0;
+        return 1;
+    }
+    int stop = 0;
+    for (int i=0; i<BreakCondCount; i++) {
+        struct BreakCond *bc = &BreakConds[i];
+        int hit = CondHolds(bc);
+        if (hit && !bc->was && !stop) {
+            snprintf(BreakReason, 80, "Break: %s=%X, %s %X", BreakRegName[bc->reg],
+                     RegRead(bc->reg), CondName[bc->cond], bc->value);
+            stop = 1;
+        }
+        bc->was = hit;                  // every edge is seen once
+    }
+    return stop;
+}
+
 
 //---------------------------------------------------------
 #ifdef VERBOSE
@@ -427,6 +656,8 @@ void TraceHist(void) {                  // dump trace history
 #endif
 
 //==============================================================================
+#else
+int DataBreak(void) {return 0;}
 #endif
 
 // Initialize useful variables in the terminal task
@@ -499,7 +730,15 @@ static char RegName[6][4] = {" T", " N", "RP", "SP", "UP", "PC"};
 void SetCursorPosition(int X, int Y){
     printf("\033[%d;%df", Y, X);
 }
+static void PutLE32(FILE *fp, uint32_t x) { // little-endian binary cell
+    for (int i=0; i<4; i++) {
+        fputc((x >> (8*i)) & 0xFF, fp);
+    }
+}
+
 void RegChanges (FILE *fp, int format) {
+    uint32_t binary[6];                 // format 3 = binary, mask then values
+    int mask = 0;
     if (!format) {                      // format 0 = debug dashboard
         SetCursorPosition(0, DumpRows+8);
     }
@@ -521,11 +760,21 @@ void RegChanges (FILE *fp, int format) {
                 case 1: // C format:
                 fprintf(fp, "    changes(%d, 0x%08X);\n", i, actual);
                 break;
+                case 3: // binary format:
+                binary[changes-1] = actual;
+                mask |= 1<<i;
+                break;
                 default:
                 fprintf(fp, "%s changed from %08X to %08X\n", reg, expected, actual);
             }
         }
     }
+    if (format == 3) {
+        fputc(mask, fp);
+        for (int i=0; i<changes; i++) {
+            PutLE32(fp, binary[i]);
+        }
+    }
     if (!format) {                      // format 0 = debug dashboard
         while (changes<4) {
             changes++;
@@ -535,17 +784,30 @@ void RegChanges (FILE *fp, int format) {
     memmove(ChangeRegs[1], ChangeRegs[0], 6*sizeof(uint32_t));
 }
 
+// Step the VM from PC=0, writing the changes after each group.
+// Format 1 = C, 2 = VHDL, 3 = binary. Binary vectors are a header of
+// "TVEC" and a cell count, then per group: IR, a byte with a bit set for
+// each register (0 to 5 = T N RP SP UP PC) that changed, and the new
+// values in register order. Cells are little-endian.
+
 void MakeTestVectors(FILE *ofp, int length, int format) {
     uint32_t * temp = (uint32_t*) malloc(RAMsize * sizeof(uint32_t));
     for (int i=0; i<RAMsize; i++) {     // stash RAM in temporary location
-        temp[i] = FetchCell((ROMsize+i)*4);
+        temp[i] = FetchCell((i-RAMsize)*4);
     }
     VMpor();
     RegChangeInit();                    // start at PC = 0
+    if (format == 3) {
+        fputs("TVEC", ofp);
+        PutLE32(ofp, length);
+    }
     for (int i=0; i<length; i++) {
         uint32_t pc = RegRead(5);
         uint32_t ir = FetchCell(pc);
         switch (format) {
+        case 3:         // binary
+            PutLE32(ofp, ir);
+            break;
         case 2:         // VHDL
             fprintf(ofp, "    newstep(x\"%08X\", %d);  -- PC = %04Xh\n", ir, i, pc);
             break;
@@ -554,12 +816,12 @@ void MakeTestVectors(FILE *ofp, int length, int format) {
         }
         Tracing=1;  VMstep(ir,0);
         Tracing=0;
-        RegChanges(ofp, 1);             // display changes in C format
+        RegChanges(ofp, format);        // changes in C, VHDL or binary format
     }
     tiffIOR = 0;
     VMpor();
     for (int i=0; i<RAMsize; i++) {     // restore RAM
-        StoreCell(temp[i], (ROMsize+i)*4);
+        StoreCell(temp[i], (i-RAMsize)*4);
     }
     free(temp);
 }
@@ -778,6 +1040,9 @@ void ShowParam(void){
 
 uint32_t vmTEST (void) {
     uint32_t normal = 0xFFFFFFFF;       // normal execution
+#ifdef TRACEABLE
+    static int32_t watch = ~0;          // RAM cell or register ID, T by default
+#endif
     printf("\033[2J");                  // CLS
     PushNumR(0xDEADC0DC);               // extra run terminator
     RegChangeInit();
@@ -787,6 +1052,11 @@ Re: DumpRegs();
     printf("\n(0..F)=digit, Enter=Clear, O=pOp, P=Push, R=Refresh, X=eXecute, ^C=Bye\n");
     #ifdef TRACEABLE
     printf("G=Goto, S=Step, V=oVer, /=Run, @=Fetch, U=dUmp, W=WipeHistory, Y=Redo, Z=Undo \n");
+    printf("L=back to Last write of Param (0..7=reg), K=Keep going back to earlier writes\n");
+    if (BreakReason[0]) {
+        printf("%s\n", BreakReason);
+        BreakReason[0] = 0;
+    }
     #else
     printf("G=Goto, S=Step, V=oVer, /=Run, @=Fetch, U=dUmp\n");
     #endif
@@ -840,6 +1110,7 @@ Re: DumpRegs();
                 case '/': do { pc = RegRead(5);
                               Tracing=1;  VMstep(FetchCell(pc),0);
                               Tracing=0;
+                              if (DataBreak()) goto Re;     // stopped on data
                           } while (0xDEADC0DC != RegRead(5));
                           PushNumR(0xDEADC0DC);
                           SetPCreg(pc);
@@ -851,11 +1122,16 @@ Re: DumpRegs();
                 case 'H': TraceHist();   break;             // H = history
 #endif
                 case 'w':
-                case 'W': uHead=0; uTail=0; uHere=0; break; // W = wipe history
+                case 'W': WipeTrace();   break;             // W = wipe history
                 case 'y':
                 case 'Y': Bell(RedoTrace());   goto Re;     // Y = Redo
                 case 'z':
                 case 'Z': Bell(UndoTrace());   goto Re;     // Z = Undo
+                case 'l':
+                case 'L': watch = WatchID(Param);           // L = back to last write
+                case 'k':
+                case 'K': Bell(ReverseToChange(watch));     // K = keep going back
+                          goto Re;
 #endif
                 default: printf("%d   ", c);
             }
@@ -9,6 +9,7 @@
 #include "config.h"
 
 extern uint32_t DbgPC;                             // last PC returned by VMstep
+extern int Tracing;                          // TRUE if recording trace history
 
 uint32_t DbgGroup (uint32_t op0, uint32_t op1,   // Execute an instruction group
                    uint32_t op2, uint32_t op3, uint32_t op4);
@@ -16,6 +17,7 @@ uint32_t DbgGroup (uint32_t op0, uint32_t op1,   // Execute an instruction group
 uint32_t PopNum (void);                                    // Pop from the stack
 void PushNum (uint32_t N);                                  // Push to the stack
 void StoreROM (uint32_t N, uint32_t addr);                       // Write to ROM
+void StoreROMs (const uint32_t *src, uint32_t addr, int cells);   // Block write
 void StoreString(char *s, int32_t address);            // Store unbounded string
 void FetchString(char *s, int32_t address, uint8_t length);        // get string
 int Rdepth(void);                                          // return stack depth
@@ -26,6 +28,9 @@ void CommaD (uint32_t x);                         // append a word to data space
 void CommaH (uint32_t x);                       // append a word to header space
 void CommaHeader (char *name, uint32_t xte, uint32_t xtc, int Size, int flags);
 
+#define WordlistThreads (HashThreads ? HashThreads : 1)
+int HashThread(char *name);                         // thread number of a name
+uint32_t ThreadHead(uint32_t wid, int thread);     // address of thread's head
 uint32_t SearchWordlist(char *name, uint32_t WID);
 void AddWordlistHead (uint32_t wid, char *name);
 uint32_t iword_FIND (void);                     // ( addr len -- addr len | 0 ht )
@@ -37,6 +42,11 @@ void ReplaceXTs(void);    // Replace XTs with executable code ( NewXT OldXT -- )
 
 void CreateTrace(void);                  // allocate memory for the trace buffer
 void DestroyTrace(void);                     // free memory for the trace buffer
+int AddBreakCond(uint32_t value, int reg, int cond);   // conditional breakpoint
+void ClearBreaks(void);                    // clear watchpoints and conditions
+int DataBreak(void);                 // TRUE if a watchpoint or condition hit
+uint32_t TraceMark(void);                   // current trace buffer position
+int TraceRAMchanges(uint32_t mark, uint32_t *ra, int max); // RAM cells changed
 
 void InitializeTermTCB(void);                           // Initialize everything
 void InitializeTIB(void);             // Initialize just the terminal task input
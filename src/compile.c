@@ -4,6 +4,7 @@
 #include "vm.h"
 #include "accessvm.h"
 #include "compile.h"
+#include "xop.h"
 #include "tiff.h"
 #include "colors.h"
 #include <string.h>
@@ -16,8 +17,24 @@
 // Hopefully, all of the opcode dependencies are in this file.
 
 static void FlushLit (void);            // forward reference
+static void Pack (int opcode);
+static int InlineHot (uint32_t addr);
+static int AutoInline;                  // profile-guided inlining is on
 uint32_t OpcodeCount[64];               // static instruction count
 
+// Wasted slots are padding, counted by cause:
+// [0] = skipped because a call or literal didn't fit in the remaining slot,
+// [1] = skipped to start a new group for control flow,
+// [2] = slot 5 left as a nop because the next opcode didn't fit there,
+// [3] = dead slots after an exit, which can't be reclaimed.
+// [0] can be reduced by moving often-called words to low ROM addresses.
+static uint32_t WastedSlots[4];         // in the current definition
+static uint32_t TotalWasted[4];         // since InitCompiler
+static int WasteCause = 1;              // cause of the next NewGroup padding
+int ShowPacking;                        // report each definition at ;
+int Optimize;                           // peephole optimizer, off by default
+static int AddPend;                     // lit 1 + or lit 4 + not compiled yet
+
 static char names[64][6] = {
     ".",     "dup",  "exit",  "+",    "2*",   "?",    "?",   "?",
     "_",     "1+",   "r>",    "?",    "2*c",  "user", "c@+", "c!+",
@@ -30,7 +47,8 @@ static char names[64][6] = {
 };
 
 char * OpName(unsigned int opcode) {
-    return names[opcode&0x3F];
+    char *name = XopName(opcode);       // experimental opcodes first
+    return name ? name : names[opcode&0x3F];
 }
 
 // Determine if opcode uses immediate data
@@ -97,6 +115,11 @@ void ListOpcodeCounts(void) {           // list the opcode profiles
     for (i=0; i<64; i++){
         printf("\n%d,\"%s\",%d", i, OpName(i), OpcodeCount[i]);
     }
+    printf("\n\"Wasted Slots\"");
+    printf("\n\"immediate\",%d", TotalWasted[0]);
+    printf("\n\"control\",%d", TotalWasted[1]);
+    printf("\n\"Slot 5\",%d", TotalWasted[2]);
+    printf("\n\"after exit\",%d", TotalWasted[3]);
 	#ifdef TRACEABLE
     printf("\n\"Dynamic Instruction Counts\"");
     for (i=0; i<64; i++){
@@ -106,17 +129,147 @@ void ListOpcodeCounts(void) {           // list the opcode profiles
 	#endif
 }
 
+#ifdef TRACEABLE
+// Opcode n-gram report, most frequent first. Each row is the opcodes and
+// their counts within one group and across groups.
+
+struct Ngram {
+    uint32_t ops;                       // opcodes, 6 bits each
+    uint32_t within, across;
+};
+
+static int NgramOrder(const void *a, const void *b) {
+    const struct Ngram *x = a;
+    const struct Ngram *y = b;
+    uint64_t nx = (uint64_t)x->within + x->across;
+    uint64_t ny = (uint64_t)y->within + y->across;
+    if (nx != ny) return (nx < ny) ? 1 : -1;
+    return (x->ops > y->ops) ? 1 : -1;
+}
+
+static int Ngrams(struct Ngram **list, uint32_t *table, int length) {
+    int n = 0;
+    for (int i=0; i<length; i++) {
+        if (table[i] | table[i+length]) n++;
+    }
+    struct Ngram *p = malloc((n + 1) * sizeof(struct Ngram));
+    n = 0;
+    for (int i=0; i<length; i++) {
+        if (table[i] | table[i+length]) {
+            p[n].ops = i;
+            p[n].within = table[i];
+            p[n++].across = table[i+length];
+        }
+    }
+    qsort(p, n, sizeof(struct Ngram), NgramOrder);
+    *list = p;
+    return n;
+}
+
+static void NgramRows(FILE *fp, int json, char *title, uint32_t *table,
+                      int size, int top) {
+    struct Ngram *list;
+    int n = Ngrams(&list, table, 1 << (6*size));
+    if ((top > 0) && (n > top)) n = top;
+    if (json) {
+        fprintf(fp, "\"%s\":[", title);
+    } else {
+        fprintf(fp, "\n\"%s\",\"Within\",\"Across\"", title);
+    }
+    for (int i=0; i<n; i++) {
+        fprintf(fp, json ? "%s\n{\"ops\":[" : "\n", i ? "," : "");
+        for (int j=size-1; j>=0; j--) {
+            fprintf(fp, "\"%s\"%s", OpName((list[i].ops >> (6*j)) & 0x3F),
+                    (json && !j) ? "" : ",");
+        }
+        fprintf(fp, json ? "],\"within\":%u,\"across\":%u}" : "%u,%u",
+                list[i].within, list[i].across);
+    }
+    if (json) fprintf(fp, "]");
+    free(list);
+}
+
+static void SlotRows(FILE *fp, int json, char *title, uint32_t table[6][64]) {
+    int rows = 0;
+    if (json) {
+        fprintf(fp, "\"%s\":{", title);
+    } else {
+        fprintf(fp, "\n\"%s\",\"Slot 0\",\"Slot 1\",\"Slot 2\",\"Slot 3\","
+                "\"Slot 4\",\"Slot 5\"", title);
+    }
+    for (int op=0; op<64; op++) {
+        uint32_t any = 0;
+        for (int s=0; s<6; s++) any |= table[s][op];
+        if (!any) continue;
+        if (json) {
+            fprintf(fp, "%s\n\"%s\":[", rows++ ? "," : "", OpName(op));
+        } else {
+            fprintf(fp, "\n\"%s\"", OpName(op));
+        }
+        for (int s=0; s<6; s++) {
+            fprintf(fp, (json && !s) ? "%u" : ",%u", table[s][op]);
+        }
+        if (json) fprintf(fp, "]");
+    }
+    if (json) fprintf(fp, "}");
+}
+
+static void NgramReport(FILE *fp, int top, int json) {
+    if (json) fprintf(fp, "{");
+    NgramRows(fp, json, "Bigrams", Bigrams, 2, top);
+    fprintf(fp, json ? ",\n" : "");
+    NgramRows(fp, json, "Trigrams", Trigrams, 3, top);
+    fprintf(fp, json ? ",\n" : "");
+    SlotRows(fp, json, "Slot use", SlotOps);
+    fprintf(fp, json ? ",\n" : "");
+    SlotRows(fp, json, "Group ends", GroupEnds);
+    fprintf(fp, json ? "}\n" : "\n");
+}
+#endif // TRACEABLE
+
+void ListNgrams(int top) {  /*EXPORT*/  // the top n-grams in csv format
+	#ifdef TRACEABLE
+    if (Bigrams == NULL) {
+        printf("\nN-grams are off, use +ngrams");
+        return;
+    }
+    NgramReport(stdout, top, 0);
+    #else
+    printf("\nNot supported");
+	#endif
+}
+
+void SaveNgrams(char *filename) {  /*EXPORT*/ // all of them, csv or json
+	#ifdef TRACEABLE
+    if (Bigrams == NULL) {
+        printf("\nN-grams are off, use +ngrams");
+        return;
+    }
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
+        tiffIOR = -199;
+        return;
+    }
+    char *ext = strrchr(filename, '.');
+    NgramReport(fp, 0, (ext != NULL) && (strcmp(ext, ".json") == 0));
+    fclose(fp);
+    #else
+    printf("\nNot supported");
+	#endif
+}
+
 void ListProfile(void) {                // list the execution profile
 	#ifdef TRACEABLE                    // in csv format
-    printf("\n\"Addr\",\"Hits\"");
+    printf("\n\"Addr\",\"Hits\",\"Cycles\"");
     int last = ROMsize;
     while (--last) {                    // end of internal ROM
         if (ProfileCounts[last] != 0) break;
     }
     for (int i=0; i<last; i++){
-        printf("\n\"%04Xh\",%u", i*4, ProfileCounts[i]);
+        printf("\n\"%04Xh\",%u,%u", i*4, ProfileCounts[i], ProfileCycles[i]);
     }
     memset(ProfileCounts, 0, ROMsize*sizeof(uint32_t));  // clear afterwards
+    memset(ProfileCycles, 0, ROMsize*sizeof(uint32_t));
     #else
     printf("\nNot supported");
 	#endif
@@ -135,13 +288,103 @@ static void AppendIR (unsigned int opcode, uint32_t imm) {
     OpcodeCount[opcode&0x3F]++;
 }
 
+// The peephole optimizer looks back at the pending literal or the last opcode
+// in the group being built, which haven't been committed to code space yet.
+// Groups always start at branch targets, so nothing can jump between them.
+
+static int PrevSlot (void) {            // slot of the last opcode, -1 if none
+    int slot = FetchByte(SLOT);
+    if (slot > 20) return -1;           // nothing in this group yet
+    if (slot == 0) return 2;
+    return slot + 6;
+}
+
+static int LastOp (void) {              // the last opcode, -1 if none
+    int slot = PrevSlot();
+    if (slot < 0) return -1;
+    return (FetchCell(IRACC) >> slot) & 0x3F;
+}
+
+static void RetractOp (void) {          // remove the last opcode
+    int slot = PrevSlot();
+    int opcode = LastOp();
+    StoreCell(FetchCell(IRACC) - (opcode << slot), IRACC);
+    StoreByte(slot, SLOT);
+    OpcodeCount[opcode]--;
+}
+
+// Returns the opcode to compile in place of opcode, -1 if nothing is needed.
+// Cancelling or folding frees slots, so it's done before checking slot 0.
+// 1+ and 4+ leave carry alone, while + sets it. So lit 1 + waits in AddPend,
+// and it's folded only if the next opcode sets carry without reading it.
+// Anything else gets lit + from FlushLit.
+
+static int SetsCarry (int opcode) {     // overwrites carry, doesn't read it
+    switch (opcode) {
+        case opADD:  case opTwoStar:  case opTwoDiv:  case opUtwoDiv:
+            return 1;
+        default: return 0;
+    }
+}
+
+static int Peephole (int opcode) {
+    if (!Optimize) return opcode;
+    if (AddPend) {
+        if (!SetsCarry(opcode)) return opcode;
+        uint32_t n = FetchCell(NEXTLIT);
+        AddPend = 0;                    // lit 1 + --> 1+, lit 4 + --> 4+
+        StoreByte(0, LITPEND);
+        Pack((n == 1) ? opOnePlus : opFourPlus);
+    }
+    if (FetchByte(LITPEND)) {
+        uint32_t n = FetchCell(NEXTLIT);
+        if ((opcode == opADD) && ((n == 1) || (n == 4))) {
+            AddPend = 1;                // fold it if carry gets overwritten
+            return -1;
+        }
+        if (opcode == opDROP) {         // lit drop --> nothing
+            StoreByte(0, LITPEND);
+            return -1;
+        }
+        return opcode;
+    }
+    int last = LastOp();
+    switch (opcode) {
+        case opSWAP:                    // swap swap --> nothing
+            if (last != opSWAP) break;
+            RetractOp();  return -1;
+        case opDROP:                    // dup drop --> nothing
+            if (last != opDUP) break;
+            RetractOp();  return -1;
+        case opADD:                     // dup + --> 2*
+            if (last == opDUP) {
+                RetractOp();  return opTwoStar;
+            }                           // fall through
+        case opAND:                     // swap + --> +, etc.
+        case opXOR:
+            if (last != opSWAP) break;
+            RetractOp();  return opcode;
+        default: break;
+    }
+    return opcode;
+}
+
 // Append a zero-operand opcode
 // Slot positions are 26, 20, 14, 8, 2, and 0
 
 static void Implicit (int opcode) {
+    opcode = Peephole(opcode);
+    if ((opcode < 0) && AddPend) return;    // lit + waits for the next opcode
     FlushLit();
-    if ((FetchByte(SLOT) == 0) && (opcode > 3))
+    if (opcode < 0) return;             // optimized away
+    Pack(opcode);
+}
+
+static void Pack (int opcode) {         // Implicit after the peephole
+    if ((FetchByte(SLOT) == 0) && (opcode > 3)) {
+        WastedSlots[2]++;
         NewGroup();                     // doesn't fit in the last slot
+    }
     AppendIR(opcode, 0);
     int8_t slot = FetchByte(SLOT);
     if (slot) {
@@ -159,8 +402,14 @@ static void Implicit (int opcode) {
 static void Explicit (int opcode, uint32_t n) {
     FlushLit();
     int8_t slot = FetchByte(SLOT);
-    if ((n >= (1 << slot)) || (slot == 0))
+    if ((n >= (1 << slot)) || (slot == 0)) {
+        if (slot == 0) {                // NewGroup can't tell slot 0 is unused
+            WastedSlots[(LastOp() == opEXIT) ? 3 : 0]++;
+        }
+        WasteCause = 0;
         NewGroup();                     // it doesn't fit
+        WasteCause = 1;
+    }
     AppendIR(opcode, n);
     StoreCell((FetchByte(SLOT) << 24) + FetchCell(CP), CALLADDR);
     StoreByte(0, SLOT);
@@ -171,7 +420,11 @@ void NewGroup (void) {                  // finish the group and start a new one
     FlushLit();                         // if a literal is pending, compile it
     uint8_t slot = FetchByte(SLOT);
     if (slot > 20) return;              // already at first slot
-    if (slot > 0) Implicit(opSKIP);     // skip unused slots
+    if (slot > 0) {                     // skip unused slots
+        int cause = (LastOp() == opEXIT) ? 3 : WasteCause;
+        WastedSlots[cause] += (slot + 4) / 6 + 1;
+        Implicit(opSKIP);
+    }
     CommaC(FetchCell(IRACC));
     InitIR();
 }
@@ -192,32 +445,424 @@ static void CompCall (uint32_t addr, int notail) {
 }
 
 void Compile (uint32_t addr) {          // the normal compile
+    if (AutoInline && InlineHot(addr)) return;
     CompCall (addr, 0);
 }
 
 // Definitions that only use implicit opcodes are very easy to compile as
 // macros.
 
+static int NextOpcode(uint32_t *addr, int *slot, uint32_t *ir) {
+    int opcode;                         // step through code one opcode at a time
+    if (*slot == 26) {
+        *ir = FetchCell(*addr);
+        *addr += 4;
+    }
+    if (*slot < 0) {
+        opcode = *ir & 3;               // slot = -4
+        *slot = 26;
+    } else {
+        opcode = (*ir >> *slot) & 0x3F; // slot = 26, 20, 14, 8, 2
+        *slot -= 6;
+    }
+    return opcode;
+}
+
 static void CompileMacro(uint32_t addr) { // compile as a macro
     int i;  int opcode;  uint32_t ir;
     int slot = 26;
     for (i=0; i<20; i++) {                // limit length of macro
-        if (slot == 26) {
-            ir = FetchCell(addr);
-            addr += 4;
-        }
-        if (slot < 0) {
-            opcode = ir & 3;                // slot = -4
-            slot = 26;
-        } else {
-            opcode = (ir >> slot) & 0x3F;   // slot = 26, 20, 14, 8, 2
-            slot -= 6;
-        }
+        opcode = NextOpcode(&addr, &slot, &ir);
         if (opcode == opEXIT) return;
         Implicit(opcode);
     } tiffIOR = -61;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Profile-guided inlining compiles hot short definitions in place of calls.
+// Hit counts come from ProfileCounts of a previous run, saved by name because
+// addresses move when the source changes. The count at a word's first group
+// is the number of times it was entered, plus any loops back to the start.
+// A call and its return cost 3+3 cycles, so each inlined call saves 6 cycles.
+// ROM growth is measured in slots, 6 per cell, and limited by a budget.
+
+#define MaxInlineOps  6                 // longest definition to inline
+#define MaxHotWords   256
+
+struct HotWord {
+    char name[32];
+    uint32_t hits;                      // entries in the profiled run
+    uint32_t sites;                     // calls compiled since loading
+    uint32_t inlined;                   // calls that were inlined
+    int32_t  growth;                    // slots added by inlining
+};
+static struct HotWord HotWords[MaxHotWords];
+static int HotCount;
+static uint32_t InlineThreshold;        // minimum hits to inline
+static int32_t InlineBudget;            // slots of ROM growth allowed
+static int32_t InlineGrowth;            // slots of ROM growth so far
+
+// Only position-independent implicit opcodes can be moved: no skips, repeats
+// or return stack access, since the call's return address would be missing.
+// Returns the number of opcodes before exit, 0 if it can't be inlined.
+
+static int Inlinable(uint32_t addr) {
+    int i;  int opcode;  uint32_t ir;
+    int slot = 26;  int n = 0;
+    for (i=0; i<18; i++) {              // nop padding doesn't count
+        opcode = NextOpcode(&addr, &slot, &ir);
+        switch (opcode) {
+            case opNOP: break;
+            case opEXIT: return n;
+            case opSKIP:   case opSKIPNZ: case opSKIPNC: case opSKIPGE:
+            case opREPTC:  case opMiREPT:
+            case opPOP:    case opPUSH:   case opRfetch: case opRP:
+            case opSetRP:  return 0;
+            default:
+                if (isImmediate(opcode)) return 0;
+                if (++n > MaxInlineOps) return 0;
+        }
+    }
+    return 0;
+}
+
+static int32_t SlotPosition(void) {     // code size in slots
+    int slot = FetchByte(SLOT);
+    int index = (slot > 20) ? 0 : 5 - slot / 6;
+    return (FetchCell(CP) / 4) * 6 + index;
+}
+
+static struct HotWord * FindHot(char *name) {
+    for (int i=0; i<HotCount; i++) {
+        if (strcmp(HotWords[i].name, name) == 0) return &HotWords[i];
+    }
+    return NULL;
+}
+
+// Compile the definition at addr inline if it's hot, short and fits the budget.
+// HEAD holds the header of the word being inlined, as left by the search.
+// Returns 1 if inlined.
+
+static int InlineHot(uint32_t addr) {
+    char name[32];
+    uint32_t ht = FetchCell(HEAD);
+    if ((FetchCell(ht-4) & 0xFFFFFF) != addr) return 0;
+    uint8_t len = FetchByte(ht + 4);
+    if ((len & 0x80) == 0) return 0;    // call-only
+    FetchString(name, ht + 5, len & 0x1F);
+    struct HotWord *hot = FindHot(name);
+    if ((hot == NULL) || (hot->hits < InlineThreshold)) return 0;
+    hot->sites++;
+    int ops = Inlinable(addr);
+    if (!ops) return 0;
+    FlushLit();                         // a call would flush it anyway
+    int slot = FetchByte(SLOT);
+    int32_t start = SlotPosition();
+    int32_t call = 6 - (start % 6);     // a call ends the group
+    if ((slot == 0) || ((addr/4) >= (1u << slot))) call += 6;
+    if ((InlineGrowth + ops - call) > InlineBudget) return 0;
+    int opcode;  uint32_t ir;
+    slot = 26;
+    while ((opcode = NextOpcode(&addr, &slot, &ir)) != opEXIT) {
+        if (opcode != opNOP) Implicit(opcode);
+    }
+    int32_t growth = SlotPosition() - start - call;
+    InlineGrowth += growth;
+    hot->growth += growth;
+    hot->inlined++;
+    return 1;
+}
+
+void AutoInlineOn(uint32_t threshold, uint32_t budget) { /*EXPORT*/
+    InlineThreshold = threshold;
+    InlineBudget = (budget * 6) / 4;    // bytes to slots
+    InlineGrowth = 0;
+    AutoInline = 1;
+}
+
+void AutoInlineOff(void) {  /*EXPORT*/
+    AutoInline = 0;
+}
+
+void LoadProfile(char *filename) {  /*EXPORT*/ // "hits name" per line
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL) {
+        tiffIOR = -199;                 // Can't open file
+        return;
+    }
+    HotCount = 0;
+    struct HotWord *hot = HotWords;
+    while ((HotCount < MaxHotWords)
+        && (fscanf(fp, "%u %31s", &hot->hits, hot->name) == 2)) {
+        hot->sites = hot->inlined = hot->growth = 0;
+        HotCount++;  hot++;
+    }
+    fclose(fp);
+}
+
+void SaveProfile(char *filename) {  /*EXPORT*/ // the hits of each ROM word
+	#ifdef TRACEABLE
+    char name[32];
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
+        tiffIOR = -199;
+        return;
+    }
+    int lists = FetchByte(WIDS) * WordlistThreads;
+    while (lists--) {                   // every thread of every wordlist
+        uint32_t wid = FetchCell(CONTEXT + (lists / WordlistThreads)*4);
+        wid = FetchCell(ThreadHead(wid, lists % WordlistThreads));
+        while (wid) {
+            uint32_t xte = FetchCell(wid - 4) & 0xFFFFFF;
+            if ((xte < ROMsize*4) && ProfileCounts[xte/4]) {
+                FetchString(name, wid + 5, FetchByte(wid + 4) & 0x1F);
+                fprintf(fp, "%u %s\n", ProfileCounts[xte/4], name);
+            }
+            wid = FetchCell(wid) & 0xFFFFFF;
+        }
+    }
+    fclose(fp);
+    #else
+    printf("\nNot supported");
+	#endif
+}
+
+#ifdef TRACEABLE
+// Code is attributed to words by the xte in their headers. A word owns the
+// cells from its xte to the end of its definition or the next word.
+
+static int OwnerOrder(const void *a, const void *b) {
+    const struct Owner *x = a;
+    const struct Owner *y = b;
+    if (x->start != y->start) return (x->start > y->start) ? 1 : -1;
+    return (x->ht > y->ht) ? 1 : -1;
+}
+
+static int SampleOrder(const void *a, const void *b) {
+    const struct Owner *x = a;
+    const struct Owner *y = b;
+    if (x->self != y->self) return (x->self < y->self) ? 1 : -1;
+    if (x->calling != y->calling) return (x->calling < y->calling) ? 1 : -1;
+    return (x->start > y->start) ? 1 : -1;
+}
+
+struct Owner * Owners(int *count) {  /*EXPORT*/ // words sorted by xte
+    uint32_t limit = SPIflashBlocks << 10;  // cells of code space
+    int n = 0, size = 1024;
+    struct Owner *p = malloc(size * sizeof(struct Owner));
+    int lists = FetchByte(WIDS) * WordlistThreads;
+    while (lists--) {                   // every thread of every wordlist
+        uint32_t ht = FetchCell(CONTEXT + (lists / WordlistThreads)*4);
+        ht = FetchCell(ThreadHead(ht, lists % WordlistThreads));
+        while (ht) {
+            uint32_t xte = FetchCell(ht - 4) & 0xFFFFFF;
+            if (!(xte & 3) && ((xte / 4) < limit)) {
+                if (n == size) {
+                    size *= 2;
+                    p = realloc(p, size * sizeof(struct Owner));
+                }
+                uint32_t length = FetchCell(ht - 12) & 0xFFFF;
+                if (length >= 255) length = limit; // unresolved or too long
+                if (length == 0) length = 1;
+                p[n].start = xte / 4;
+                p[n].end = xte / 4 + length;
+                p[n].ht = ht;
+                p[n].self = p[n].calling = 0;
+                n++;
+            }
+            ht = FetchCell(ht) & 0xFFFFFF;
+        }
+    }
+    qsort(p, n, sizeof(struct Owner), OwnerOrder);
+    for (int i=1; i<n; i++) {           // clip at the next definition
+        if (p[i-1].end > p[i].start) p[i-1].end = p[i].start;
+    }
+    *count = n;
+    return p;
+}
+
+struct Owner * OwnerOf(struct Owner *p, int n, uint32_t cell) {  /*EXPORT*/
+    int lo = 0, hi = n;
+    while (lo < hi) {                   // find the last start <= cell
+        int mid = (lo + hi) / 2;
+        if (p[mid].start <= cell) lo = mid + 1; else hi = mid;
+    }
+    if (lo && (cell < p[lo-1].end)) return &p[lo-1];
+    return NULL;
+}
+#endif // TRACEABLE
+
+void ListSamples(int top) {  /*EXPORT*/ // sampling profile by word
+	#ifdef TRACEABLE
+    if (Samples == NULL) {
+        printf("\nSampling is off, use n SAMPLING");
+        return;
+    }
+    int n;
+    uint32_t other = 0;
+    char name[32];
+    struct Owner *p = Owners(&n);
+    for (uint32_t i=0; i<SampleCount; i++) {
+        struct Owner *w = OwnerOf(p, n, Samples[i*2]);
+        if (w) w->self++; else other++;
+        w = OwnerOf(p, n, Samples[i*2 + 1] / 4);
+        if (w) w->calling++;
+    }
+    qsort(p, n, sizeof(struct Owner), SampleOrder);
+    if ((top > 0) && (n > top)) n = top;
+    printf("\n\"Samples\",%u,\"Period\",%u", SampleCount, SamplePeriod);
+    printf("\n\"Word\",\"Self\",\"Calling\",\"Self %%\"");
+    for (int i=0; i<n; i++) {
+        if (!(p[i].self | p[i].calling)) break;
+        FetchString(name, p[i].ht + 5, FetchByte(p[i].ht + 4) & 0x1F);
+        printf("\n\"%s\",%u,%u,%.1f", name, p[i].self, p[i].calling,
+               100.0 * p[i].self / (SampleCount ? SampleCount : 1));
+    }
+    if (other) printf("\n\"(other)\",%u,,", other);
+    free(p);
+    #else
+    printf("\nNot supported");
+	#endif
+}
+
+// Source line map: the file and line that compiled each ROM cell. Code
+// compiled while a line is interpreted belongs to that line. A group that
+// spans lines belongs to the line that finished it. Cells compiled some other
+// way get the line of the definition they are in, from its header.
+
+#ifdef TRACEABLE
+static uint32_t *SourceLines;           // (file ID << 16) + line, 0 = unknown
+static uint32_t SourceMark;             // CP in cells at the last SourceLine
+
+struct LineHeat {
+    uint32_t key;                       // (file ID << 16) + line
+    uint32_t addr;                      // first cell
+    uint32_t hits, cycles;
+    uint32_t cells, covered;            // cells, and those executed
+};
+
+static int LineOrder(const void *a, const void *b) {
+    const struct LineHeat *x = a;
+    const struct LineHeat *y = b;
+    if (x->key != y->key) return (x->key > y->key) ? 1 : -1;
+    return (x->addr > y->addr) ? 1 : -1;
+}
+
+static int HeatOrder(const void *a, const void *b) {
+    const struct LineHeat *x = a;
+    const struct LineHeat *y = b;
+    if (x->cycles != y->cycles) return (x->cycles < y->cycles) ? 1 : -1;
+    return LineOrder(a, b);
+}
+#endif // TRACEABLE
+
+void SourceLine(int fileid, int line) {  /*EXPORT*/ // code since the last call
+	#ifdef TRACEABLE
+    uint32_t cp = FetchCell(CP) / 4;
+    if (SourceLines == NULL) {
+        SourceLines = calloc(MaxROMsize, sizeof(uint32_t));
+    }
+    if (cp > ROMsize) cp = ROMsize;
+    if (line) {
+        for (uint32_t i = SourceMark; i < cp; i++) {
+            SourceLines[i] = (fileid << 16) + line;
+        }
+    }
+    SourceMark = cp;
+	#endif
+}
+
+uint32_t * SourceMap(uint32_t *cells) {  /*EXPORT*/ // line of each ROM cell
+	#ifdef TRACEABLE
+    int n;
+    uint32_t used = FetchCell(CP) / 4;
+    if (used > ROMsize) used = ROMsize;
+    uint32_t *map = calloc(used + 1, sizeof(uint32_t));
+    struct Owner *p = Owners(&n);
+    for (uint32_t i=0; i<used; i++) {
+        if (SourceLines && SourceLines[i]) {
+            map[i] = SourceLines[i];
+            continue;
+        }
+        struct Owner *w = OwnerOf(p, n, i);
+        if (w) map[i] = (FetchByte(w->ht - 9) << 16)
+                      + (FetchByte(w->ht - 1) << 8) + FetchByte(w->ht - 5);
+    }
+    free(p);
+    *cells = used;
+    return map;
+    #else
+    *cells = 0;
+    return NULL;
+	#endif
+}
+
+void ListLines(int top) {  /*EXPORT*/   // hits and cycles by source line
+	#ifdef TRACEABLE
+    uint32_t used;
+    uint32_t *map = SourceMap(&used);
+    struct LineHeat *h = malloc((used + 1) * sizeof(struct LineHeat));
+    int lines = 0;
+    uint32_t cells = 0, covered = 0;
+    for (uint32_t i=0; i<used; i++) {
+        if ((map[i] & 0xFFFF) == 0) continue;   // unknown line
+        h[lines].key = map[i];
+        h[lines].addr = i;
+        h[lines].hits = ProfileCounts[i];
+        h[lines].cycles = ProfileCycles[i];
+        h[lines].cells = 1;
+        h[lines++].covered = (ProfileCounts[i] != 0);
+    }
+    qsort(h, lines, sizeof(struct LineHeat), LineOrder);
+    int n = 0;
+    for (int i=0; i<lines; i++) {       // merge the cells of each line
+        if (n && (h[n-1].key == h[i].key)) {
+            h[n-1].hits += h[i].hits;
+            h[n-1].cycles += h[i].cycles;
+            h[n-1].cells++;
+            h[n-1].covered += h[i].covered;
+        } else h[n++] = h[i];
+        cells++;
+        covered += h[i].covered;
+    }
+    qsort(h, n, sizeof(struct LineHeat), HeatOrder);
+    if ((top > 0) && (n > top)) n = top;
+    int words;
+    char wname[32];
+    struct Owner *p = Owners(&words);
+    printf("\n\"File\",\"Line\",\"Word\",\"Hits\",\"Cycles\",\"Cells\",\"Covered\"");
+    for (int i=0; i<n; i++) {
+        struct Owner *w = OwnerOf(p, words, h[i].addr);
+        wname[0] = 0;
+        if (w) FetchString(wname, w->ht + 5, FetchByte(w->ht + 4) & 0x1F);
+        printf("\n\"%s\",%u,", LocateFilename(h[i].key >> 16), h[i].key & 0xFFFF);
+        printf("\"%s\",%u,%u,%u,%u", wname, h[i].hits, h[i].cycles,
+               h[i].cells, h[i].covered);
+    }
+    printf("\n\"Coverage\",%u,%u,%.1f", covered, cells,
+           100.0 * covered / (cells ? cells : 1));
+    free(p);
+    free(h);
+    free(map);
+    #else
+    printf("\nNot supported");
+	#endif
+}
+
+void ListInlined(void) {  /*EXPORT*/    // report the size/speed tradeoff
+    uint64_t saved = 0;
+    printf("\n\"Word\",\"Hits\",\"Sites\",\"Inlined\",\"Slots\",\"Cycles\"");
+    for (int i=0; i<HotCount; i++) {
+        struct HotWord *hot = &HotWords[i];
+        if (!hot->inlined) continue;    // cycles saved assumes even call sites
+        uint64_t cycles = (uint64_t)hot->hits * 6 * hot->inlined / hot->sites;
+        printf("\n\"%s\",%u,%u,%u,%d,%llu", hot->name, hot->hits,
+               hot->sites, hot->inlined, hot->growth, (unsigned long long)cycles);
+        saved += cycles;
+    }
+    printf("\n\"Total\",,,,%d,%llu", InlineGrowth, (unsigned long long)saved);
+}
+
 // ; does several things:
 // 1. Attempt to convert the last call to a jump.
 // 2. Otherwise, append an EXIT and end the group.
@@ -253,12 +898,27 @@ void CompSemi (void) {  /*EXPORT*/
         uint32_t org = FetchCell(wid-4) & 0xFFFFFF; // start address = xte
         uint32_t cp  = FetchCell(CP);     // end address
         uint32_t length = (cp - org) / 4; // length in cells
+        if (ShowPacking) {
+            char name[32];
+            FetchString(name, wid + 5, FetchByte(wid + 4) & 0x1F);
+            printf("\n%s: %d groups, wasted slots: %d immediate, %d control, "
+                   "%d slot 5, %d after exit ", name, length,
+                   WastedSlots[0], WastedSlots[1], WastedSlots[2], WastedSlots[3]);
+        }
         if (length>255) length=255;       // limit to 8-bit
         StoreROM(length + 0xFFFF0000, wid - 12);
     }
+    ClearWasted();
     StoreCell(0, STATE);
 }
 
+void ClearWasted (void) {  /*EXPORT*/   // start counting a new definition
+    for (int i=0; i<4; i++) {
+        TotalWasted[i] += WastedSlots[i];
+        WastedSlots[i] = 0;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 static void HardLit (int32_t N) {
@@ -277,10 +937,13 @@ static void HardLit (int32_t N) {
 }
 
 static void FlushLit(void) {            // compile a literal if it's pending
+    int add = AddPend;                  // and the + the peephole held back
+    AddPend = 0;
     if (FetchByte(LITPEND)) {
         StoreByte(0, LITPEND);
         HardLit(FetchCell(NEXTLIT));
     }
+    if (add) Pack(opADD);               // carry may be used, keep the +
     StoreByte(0, CALLED);               // everything clears the call tail
 }
 
@@ -293,6 +956,7 @@ void Literal (uint32_t N) { /*EXPORT*/  // cache the newest literal
 }
 
 static void Immediate (uint32_t op) {   // expecting cached immediate data
+    if (AddPend) FlushLit();            // the literal was an operand of +
     if (FetchByte(LITPEND)) {
         StoreByte(0, LITPEND);
         Explicit(op, FetchCell(NEXTLIT));
@@ -575,7 +1239,7 @@ void Execute(uint32_t xt) {
     DbgGroup(opDUP, opPORT, opPUSH, opEXIT, opNOP); // Jump to code to run
     DbgPC = xt;
     for (i=1; i<RunLimit; i++) {
-        if (DbgPC == breakpoint) {
+        if ((DbgPC == breakpoint) || DataBreak()) { // or watchpoint hit
             DbgPC = vmTEST();                       // invoke low level debugger
             if (!DbgPC) {                           // 0 quits early
                 DbgGroup(opPOP, opDROP, opEXIT, opSKIP, opNOP); // restore PC
@@ -633,7 +1297,7 @@ void tiffFUNC (int32_t n) {   /*EXPORT*/
 	}
 }
 
-static void AddImplicit(int opcode, char *name) {
+void AddImplicit(int opcode, char *name) {  /*EXPORT*/
     CommaH(opcode);
     CommaHeader(name, ~2, ~3, 0, 0);
 }
@@ -656,6 +1320,8 @@ static void AddUserVar(int index, char *name) {
 void InitCompiler(void) {  /*EXPORT*/   // Initialize the compiler
     InitIR();
     memset(OpcodeCount, 0, sizeof(uint32_t)*64); // clear static opcode counters
+    memset(WastedSlots, 0, sizeof(WastedSlots));
+    memset(TotalWasted, 0, sizeof(TotalWasted));
     CommaHeader("|", ~4, ~8, 0, 0);     // skip to new opcode group
     AddImplicit(opNOP       , "nop");
     AddImplicit(opDUP       , "dup");
@@ -7,17 +7,41 @@
 
 void InitIR (void);                             // clear internal compiler state
 void InitCompiler(void);               // load the dictionary with basic opcodes
+void AddImplicit(int opcode, char *name);                // header for an opcode
+extern uint32_t OpcodeCount[64];                     // static instruction count
 void Literal (uint32_t n);                                  // compile a literal
 void tiffFUNC (int32_t n);                                 // execute a function
 void CompSemi (void);                                          // end definition
 void CompExit (void);                                            // compile exit
 void CompComma (void);                                    // compile cell to ROM
 void NewGroup (void);                           // close out pending instruction
+void ClearWasted (void);                          // start counting wasted slots
+extern int ShowPacking;                              // report wasted slots at ;
+extern int Optimize;                             // peephole optimizer is on
 void tiffMACRO (void);                  // convert current definition to a macro
 void tiffCALLONLY (void);                 // tag current definition as call-only
 void tiffANON (void);                     // tag current definition as anonymous
 void ListOpcodeCounts(void);                    // list the opcode count profile
+void ListNgrams(int top);                        // top opcode n-grams, slot use
+void SaveNgrams(char *filename);                    // all of them, .json or csv
 void ListProfile(void);                              // list the ROM hit profile
+void SaveProfile(char *filename);               // save ROM hits by word name
+void LoadProfile(char *filename);                 // load hits for auto-inline
+void AutoInlineOn(uint32_t threshold, uint32_t budget);  // inline hot words
+void AutoInlineOff(void);                                 // stop auto-inline
+void ListInlined(void);                     // report the size/speed tradeoff
+// Words by code address, from the xte and length in their headers
+struct Owner {
+    uint32_t start, end;                // cell addresses
+    uint32_t ht;                        // header
+    uint32_t self, calling;             // samples, for .SAMPLES
+};
+struct Owner * Owners(int *count);         // words sorted by start, malloced
+struct Owner * OwnerOf(struct Owner *p, int n, uint32_t cell);     // or NULL
+void ListSamples(int top);                        // sampling profile by word
+void SourceLine(int fileid, int line);        // code since last call is here
+uint32_t * SourceMap(uint32_t *cells);      // file and line of each ROM cell
+void ListLines(int top);                           // hits and cycles by line
 
 uint32_t DisassembleIR(uint32_t IR);         // disassemble an instruction group
 void NoExecute (void);                                 // ensure we're compiling
@@ -15,9 +15,26 @@
 #define MaxRAMsize      0x40000                   /* 4M bytes maximum RAM size */
 #define MaxFlashCells   0x80000                 /* 8M bytes maximum Flash size */
 
-// Instruments the VM to allow Undo and Redo
+// AXI space model for the burst user functions, see doc/memory.md
+#define AXIsizeDefault  0x10000             /* 256K bytes of AXI backing store */
+#define MaxAXIsize      0x1000000                /* 64M bytes maximum AXI size */
+#define AXIlatency      20                    /* clock cycles to start a burst */
+
+// Time-slice interrupt for preemptive multitasking, see forth/tasker.f
+#define TimerVector     5           /* ISR cell address, after CRC and LENGTH */
+#define IRQlines        16         /* interrupt lines, 0 is the time slice */
+#define MaxTasks        16                 /* tasks tracked by cycle accounting */
+#define MaxSamples      65536      /* sampling profiler, PC and return address */
+
+// Header search threads per wordlist, 0 or a power of 2. 0 is a single list.
+// Hashed threads cost HashThreads cells of RAM per wordlist.
+#define HashThreads     0
+
+// Instruments the VM to allow Undo and Redo. A VM built for COSIM leaves it off.
+#ifndef COSIMLIB
 #define TRACEABLE
-#define TraceDepth 12           /* Log2 of the trace buffer size, 13*2^N bytes */
+#endif
+#define TraceDepth 12           /* Log2 of the trace buffer size, 28*2^N bytes */
 
 // number of rows in the CPU register dump, minimum 9, maximum 12
 #define DumpRows           10
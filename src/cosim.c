@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "config.h"
+#include "vm.h"
+#include "accessvm.h"
+#include "cosim.h"
+
+#if _WIN32
+#include <windows.h>
+#include <io.h>
+#define dup   _dup
+#define dup2  _dup2
+#define close _close
+#define NullDevice "NUL"
+#else
+#include <dlfcn.h>
+#include <unistd.h>
+#define NullDevice "/dev/null"
+#endif
+
+// Lock-step co-simulation of Tiff's VM against another VM build.
+// The other VM is a shared library (.so or .dll) built from any vm.c without
+// TRACEABLE, for example one of the examples or a faster engine:
+//   cc -shared -fPIC -o vm2.so vm.c vmUser.c flash.c vmConsole.c
+// Tiff's own sources also need rs232.c and the stand-ins in cosimlib.c,
+// see there. The other VM's console output is thrown away, and keyboard
+// input can't be co-simulated since only one VM gets each key.
+// Both start at POR with the same ROM and flash and run one group at a time.
+// After each group the registers and the RAM cells written by Tiff's VM are
+// compared. All of RAM is compared every SweepGroups groups to catch stray
+// writes by the other VM. The first difference stops the run with a diff.
+
+#ifdef TRACEABLE
+
+#define SweepGroups  1024
+#define MaxDirty     64                 // more than this sweeps all of RAM
+
+struct OtherVM {
+    void     (*vmMEMinit)(char *name);
+    void     (*VMpor)(void);
+    uint32_t (*VMstep)(uint32_t IR, int Paused);
+    uint32_t (*vmRegRead)(int ID);
+    uint32_t (*FetchCell)(int32_t addr);
+    int      (*WriteROM)(uint32_t data, uint32_t address);
+    int      (*FlashWrite)(uint32_t x, uint32_t addr);
+    uint32_t *size[3];                  // NULL if the sizes are fixed
+};
+
+static char *SizeName[3] = {"ROMsize", "RAMsize", "SPIflashBlocks"};
+
+static void *Lookup(void *lib, char *name) {
+#if _WIN32
+    return (void *)GetProcAddress((HMODULE)lib, name);
+#else
+    return dlsym(lib, name);
+#endif
+}
+
+static void *Symbol(void *lib, char *name) {
+    void *p = Lookup(lib, name);
+    if (p == NULL) printf("\n%s is missing", name);
+    return p;
+}
+
+static void UnloadOther(void *lib) {
+#if _WIN32
+    FreeLibrary((HMODULE)lib);
+#else
+    dlclose(lib);
+#endif
+}
+
+static void *LoadOther(char *filename, struct OtherVM *vm) {
+#if _WIN32
+    void *lib = (void *)LoadLibraryA(filename);
+    if (lib == NULL) {
+        printf("\n%s: error %lu", filename, (unsigned long)GetLastError());
+        return NULL;
+    }
+#else
+    void *lib = dlopen(filename, RTLD_NOW | RTLD_LOCAL);
+    if (lib == NULL) {
+        printf("\n%s", dlerror());
+        return NULL;
+    }
+#endif
+    vm->vmMEMinit = Symbol(lib, "vmMEMinit");
+    vm->VMpor     = Symbol(lib, "VMpor");
+    vm->VMstep    = Symbol(lib, "VMstep");
+    vm->vmRegRead = Symbol(lib, "vmRegRead");
+    vm->FetchCell = Symbol(lib, "FetchCell");
+    vm->WriteROM  = Symbol(lib, "WriteROM");
+    vm->FlashWrite = Symbol(lib, "FlashWrite");
+    for (int i=0; i<3; i++) {
+        vm->size[i] = Lookup(lib, SizeName[i]);
+    }
+    if (vm->vmMEMinit && vm->VMpor && vm->VMstep && vm->vmRegRead
+     && vm->FetchCell && vm->WriteROM && vm->FlashWrite) return lib;
+    UnloadOther(lib);
+    return NULL;
+}
+
+// Both VMs share stdout, so the other one writes to the null device.
+
+static int Console = -1;                // stdout while muted
+static FILE *Null;
+
+static void Mute(int on) {
+    fflush(stdout);
+    if (on) {
+        if (Null == NULL) Null = fopen(NullDevice, "w");
+        if (Null == NULL) return;
+        Console = dup(fileno(stdout));
+        dup2(fileno(Null), fileno(stdout));
+    } else if (Console >= 0) {
+        dup2(Console, fileno(stdout));
+        close(Console);
+        Console = -1;
+    }
+}
+
+static char RegName[6][4] = {" T", " N", "RP", "SP", "UP", "PC"};
+
+static int SameRegs(struct OtherVM *vm) {
+    int diffs = 0;
+    for (int i=0; i<6; i++) {
+        uint32_t a = vmRegRead(i);
+        uint32_t b = vm->vmRegRead(i);
+        if (a != b) {
+            printf("\n%s: %08X <> %08X", RegName[i], a, b);
+            diffs++;
+        }
+    }
+    return !diffs;
+}
+
+// Give the other VM Tiff's memory sizes, ROM and flash contents.
+// Code can run past internal ROM into flash, and headers may be in flash.
+
+static int CopyMemory(struct OtherVM *vm) {
+    uint32_t sizes[3] = {ROMsize, RAMsize, SPIflashBlocks};
+    for (int i=0; i<3; i++) {           // embedded builds have fixed sizes
+        if (vm->size[i]) *vm->size[i] = sizes[i];
+    }
+    vm->vmMEMinit(NULL);
+    for (int i=0; i<ROMsize; i++) {     // embedded ROMs ignore this
+        vm->WriteROM(FetchCell(i*4), i*4);
+    }
+    uint32_t base = (ROMsize + RAMsize) * 4;
+    int n = SPIflashBlocks << 10;
+    while (n && (FetchCell(base + (n-1)*4) == 0xFFFFFFFF)) n--;
+    for (int i=0; i<n; i++) {           // program the used part of flash
+        uint32_t x = FetchCell(base + i*4);
+        if (x != 0xFFFFFFFF) {
+            int ior = vm->FlashWrite(x, base + i*4);
+            if (ior) return ior;
+        }
+    }
+    return 0;
+}
+
+static int SameRAM(struct OtherVM *vm, uint32_t ra) {
+    int32_t addr = (ra - RAMsize) * 4;  // RAM is at negative addresses
+    uint32_t a = FetchCell(addr);
+    uint32_t b = vm->FetchCell(addr);
+    if (a == b) return 1;
+    printf("\nRAM[%X]: %08X <> %08X", addr, a, b);
+    return 0;
+}
+
+// Run both VMs for up to length groups, return the number that matched.
+// Tiff's RAM is restored afterwards.
+
+int CoSim(char *filename, int length) {
+    struct OtherVM vm;
+    void *lib = LoadOther(filename, &vm);
+    if (lib == NULL) {
+        tiffIOR = -199;                 // Can't open file
+        return 0;
+    }
+    uint32_t *temp = (uint32_t*) malloc(RAMsize * sizeof(uint32_t));
+    for (int i=0; i<RAMsize; i++) {     // stash RAM in temporary location
+        temp[i] = FetchCell((i-RAMsize)*4);
+    }
+    uint32_t dirty[MaxDirty];
+    int i, ok = 1;
+    Mute(1);
+    int ior = CopyMemory(&vm);
+    Mute(0);
+    if (ior) {
+        printf("\nCan't copy flash, ior=%d", ior);
+        length = ok = 0;
+    }
+    VMpor();
+    Mute(1);  vm.VMpor();
+    Mute(0);
+    for (i=0; (i<length) && ok; i++) {
+        uint32_t pc = vmRegRead(5);
+        uint32_t ir = FetchCell(pc);
+        uint32_t mark = TraceMark();
+        Tracing=1;  VMstep(ir,0);
+        Tracing=0;
+        Mute(1);  vm.VMstep(ir,0);
+        Mute(0);
+        ok = SameRegs(&vm);
+        int n = TraceRAMchanges(mark, dirty, MaxDirty);
+        int sweep = (n > MaxDirty) || (i == (length-1))
+                 || ((i % SweepGroups) == (SweepGroups-1));
+        if (n > MaxDirty) n = MaxDirty; // too many to list, check them all
+        while (n--) {
+            ok &= SameRAM(&vm, dirty[n]);
+        }
+        if (sweep) {
+            for (int ra=0; ra<RAMsize; ra++) {
+                ok &= SameRAM(&vm, ra);
+            }
+        }
+        if (!ok) {
+            printf("\nGroup %d: IR=%08X at PC=%X differs", i, ir, pc);
+            i--;
+        }
+    }
+    printf("\n%d groups matched ", i);
+    tiffIOR = 0;
+    VMpor();
+    for (int i=0; i<RAMsize; i++) {     // restore RAM
+        StoreCell(temp[i], (i-RAMsize)*4);
+    }
+    free(temp);
+    UnloadOther(lib);
+    return i;
+}
+
+#endif // TRACEABLE
@@ -0,0 +1,10 @@
+//===============================================================================
+// cosim.h
+//===============================================================================
+#ifndef __COSIM_H__
+#define __COSIM_H__
+
+// Run Tiff's VM and a VM in a shared library in lock-step
+int CoSim(char *filename, int length);         // returns # of groups matched
+
+#endif // __COSIM_H__
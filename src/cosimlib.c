@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "config.h"
+#include "vm.h"
+#include "flash.h"
+
+// The Tiff functions that vm.c and vmHost.c call, for building them into
+// another VM for COSIM without the rest of Tiff:
+//   cc -shared -fPIC -DCOSIMLIB -o vm2.so vm.c vmUser.c flash.c vmHost.c
+//      vmConsole.c rs232.c cosimlib.c
+// COSIMLIB also leaves TRACEABLE off. Tiff itself compiles this file empty.
+
+#ifdef COSIMLIB
+
+char * LoadFlashFilename = NULL;        // COSIM copies flash in
+
+void FetchString(char *s, int32_t address, uint8_t length){
+    int i;  char c;                     // Get a string from RAM
+    for (i=0; i<length; i++) {
+        c = FetchByte(address++);
+        *s++ = c;
+    }   *s++ = 0;                       // end in trailing zero
+}
+
+#endif // COSIMLIB
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include "vm.h"
 #include "accessvm.h"
+#include "tiff.h"
 #include <string.h>
 #include <time.h>
 
@@ -19,19 +20,259 @@ char * GetTime(void) {                  // get time/date string
 
 uint32_t * rom;
 
+// Tree shaking blanks the definitions an application can't reach, so the
+// interactive-only words don't end up in the ROM image. Definitions are the
+// spans of code found through the headers, ending at the resolved length or
+// the next definition. Everything else (boot vectors, :noname code, idata and
+// other tables) is kept and scanned. A definition is live if an address inside
+// it is a call or jump target, a literal, or any cell value found in live ROM
+// or in RAM, so xt tables and defers keep their targets. Live code stays where
+// it is: xts in data can't be told from numbers, so it isn't relocated.
+// The headers of dead definitions are unlinked and blanked, so a target that
+// searches its own headers can't find erased code. A header the image can't
+// unlink keeps its definition: one outside the ROM image (in flash) or at the
+// head of a thread, whose pointer is in RAM. Kept headers keep their xtc.
+
+int ShakeROM;                           // shake the ROM image before output
+#define MaxShakeRoots 64
+static uint32_t ShakeRoots[MaxShakeRoots];
+static int ShakeRootCount;
+
+void ShakeRoot (uint32_t xt) {  /*EXPORT*/  // keep a definition
+    if (ShakeRootCount < MaxShakeRoots) {
+        ShakeRoots[ShakeRootCount++] = xt;
+    } else tiffIOR = -8;                // dictionary overflow
+}
+
+static int32_t * owner;                 // definition of each cell, -1 if none
+static uint32_t * spans;                // start and end cell of each definition
+static uint8_t * live;
+static uint32_t * todo;                 // cells waiting to be scanned
+static uint32_t todos;
+
+struct ShakeHead {
+    uint32_t ht;                        // cell address of the link
+    uint32_t xte, xtc;                  // byte addresses
+    uint32_t cells;                     // size, from cell -3 to the name's end
+    int pinned;                         // the link to it can't be changed
+};
+static struct ShakeHead * heads;
+static uint8_t * inhead;                // cell is part of a header in the image
+
+static void Reach (uint32_t addr, uint32_t used) { // addr may point into code
+    if ((addr & 3) || ((addr / 4) >= used)) return;
+    int32_t def = owner[addr / 4];
+    if ((def < 0) || live[spans[def*2]]) return;
+    for (uint32_t i = spans[def*2]; i < spans[def*2 + 1]; i++) {
+        live[i] = 1;
+        todo[todos++] = i;
+    }
+}
+
+static void ScanCell (uint32_t x, uint32_t used) {
+    Reach(x, used);                     // the cell may be an xt
+    int slot = 26;
+    while (slot >= 0) {
+        int opcode = (x >> slot) & 0x3F;
+        uint32_t imm = x & ((1 << slot) - 1);
+        switch (opcode) {
+            case opCALL:
+            case opJUMP: Reach(imm * 4, used);  return;
+            case opLIT:  Reach(imm, used);      return;
+            case opLitX:                // upper bits are beyond ROM
+            case opUSER:
+            case opHost: return;
+            default: break;
+        }
+        slot -= 6;
+    }
+}
+
+static int HeadIsDead (struct ShakeHead *h, uint32_t used) {
+    if (h->pinned || ((h->ht + h->cells) > used)) return 0;
+    uint32_t xt = h->xte / 4;
+    if ((h->xte & 3) || (xt >= used) || (owner[xt] < 0)) return 0;
+    return (spans[owner[xt]*2] == xt) && !live[xt];
+}
+
+static uint32_t TreeShake (uint32_t used) {
+    owner = (int32_t*) malloc(used * sizeof(int32_t));
+    spans = (uint32_t*) malloc(used * 2 * sizeof(uint32_t));
+    live = (uint8_t*) calloc(used, 1);
+    todo = (uint32_t*) malloc(used * sizeof(uint32_t));
+    inhead = (uint8_t*) calloc(used, 1);
+    int maxheads = 1024;
+    heads = (struct ShakeHead*) malloc(maxheads * sizeof(struct ShakeHead));
+    for (uint32_t i=0; i<used; i++) owner[i] = -1;
+    int32_t defs = 0;  int nheads = 0;
+    int lists = FetchByte(WIDS) * WordlistThreads;
+    while (lists--) {                   // find the definitions
+        uint32_t ht = FetchCell(CONTEXT + (lists / WordlistThreads)*4);
+        ht = FetchCell(ThreadHead(ht, lists % WordlistThreads));
+        int pinned = 1;                 // the thread's head is in RAM
+        while (ht) {
+            uint32_t xte = FetchCell(ht - 4) & 0xFFFFFF;
+            if (!(xte & 3) && ((xte / 4) < used) && (owner[xte / 4] < 0)) {
+                uint32_t length = FetchCell(ht - 12) & 0xFFFF;
+                if (length >= 255) length = used; // unresolved or too long
+                if (length == 0) length = 1;
+                spans[defs*2] = xte / 4;
+                spans[defs*2 + 1] = xte / 4 + length;
+                owner[xte / 4] = defs++;
+            }
+            if (nheads == maxheads) {
+                maxheads *= 2;
+                heads = (struct ShakeHead*) realloc(heads,
+                        maxheads * sizeof(struct ShakeHead));
+            }
+            struct ShakeHead *h = &heads[nheads++];
+            h->ht = ht / 4 - 3;         // first cell of the header
+            h->cells = 4 + (FetchByte(ht + 4) & 0x1F) / 4 + 1;
+            h->xte = xte;
+            h->xtc = FetchCell(ht - 8) & 0xFFFFFF;
+            h->pinned = pinned;
+            pinned = (ht / 4) >= used;  // a link outside the image
+            for (uint32_t i = h->ht; (i < h->ht + h->cells) && (i < used); i++) {
+                inhead[i] = 1;
+            }
+            ht = FetchCell(ht) & 0xFFFFFF;
+        }
+    }
+    int32_t def = -1;                   // clip spans at the next definition
+    for (uint32_t i=0; i<used; i++) {
+        if (owner[i] >= 0) {            // a definition starts here
+            if ((def >= 0) && (spans[def*2 + 1] > i)) spans[def*2 + 1] = i;
+            def = owner[i];
+        } else if ((def >= 0) && (i < spans[def*2 + 1])) {
+            owner[i] = def;
+        } else def = -1;
+    }
+    if ((def >= 0) && (spans[def*2 + 1] > used)) spans[def*2 + 1] = used;
+    for (uint32_t i=0; i<used; i++) {
+        if ((owner[i] >= 0) || inhead[i]) continue;
+        live[i] = 1;                    // everything else is kept
+        todo[todos++] = i;
+    }
+    for (int i=0; i<ShakeRootCount; i++) {
+        Reach(ShakeRoots[i], used);
+    }
+    for (uint32_t i=0; i<RAMsize; i++) {
+        Reach(FetchCell((i - RAMsize) * 4), used);
+    }
+    do {                                // kept headers can reach more code
+        while (todos) {
+            ScanCell(rom[todo[--todos]], used);
+        }
+        for (int i=0; i<nheads; i++) {
+            if (HeadIsDead(&heads[i], used)) continue;
+            Reach(heads[i].xte, used);
+            Reach(heads[i].xtc, used);
+        }
+    } while (todos);
+    uint32_t prev = 0;                  // unlink and blank the dead headers
+    for (int i=0; i<nheads; i++) {
+        struct ShakeHead *h = &heads[i];
+        if (!HeadIsDead(h, used)) {
+            prev = h->ht + 3;           // the link cell
+            continue;
+        }
+        if (prev < used) {
+            rom[prev] = (rom[prev] & 0xFF000000) | (rom[h->ht + 3] & 0xFFFFFF);
+        }
+        for (uint32_t j=0; j<h->cells; j++) {
+            rom[h->ht + j] = 0xFFFFFFFF;
+        }
+    }
+    uint32_t kept = 0;  uint32_t keptdefs = 0;
+    for (uint32_t i=0; i<used; i++) {
+        if (live[i] || (inhead[i] && (rom[i] != 0xFFFFFFFF))) {
+            kept++;
+            if ((owner[i] >= 0) && (spans[owner[i]*2] == i)) keptdefs++;
+        } else {
+            rom[i] = 0xFFFFFFFF;
+        }
+    }
+    printf("\nTree shaking kept %d of %d cells, %d of %d definitions ",
+           kept, used, keptdefs, defs);
+    free(owner);  free(spans);  free(live);  free(todo);
+    free(heads);  free(inhead);
+    todos = 0;
+    while (used--) {
+        if (rom[used] != 0xFFFFFFFF) break;
+    }
+    return used + 1;
+}
+
+// rom holds a snapshot of the used part of a memory space. It is kept until
+// ROM or flash is written (see ROMchanged), so a template with several ROM
+// macros reads the VM once. A shaken image depends on RAM too, so it isn't kept.
+
+static uint32_t romSize;                // space the snapshot is of, 0 if none
+static int32_t romUsed;                 // cells up to the last non-blank one
+
 static int32_t ROMwords (uint32_t size) {     // read ROM image to local memory
-    if (NULL == rom) {
-        rom = (uint32_t*) malloc(MaxROMsize * sizeof(uint32_t));
+    if (rom && !ROMchanged && (size == romSize)) {
+        return romUsed;
+    }
+    uint32_t i = size;
+    while (--i) {                       // find the last non-blank word
+        if (FetchCell(i*4) != 0xFFFFFFFF) break;
+    }
+    free(rom);
+    rom = (uint32_t*) malloc((i+1) * sizeof(uint32_t));
+    for (uint32_t j=0; j<=i; j++) {     // fill rom for local processing
+        rom[j] = FetchCell(j*4);        // read through the VM's debug interface
     }
-    uint32_t i;
-    for (i=0; i<size; i++) {            // fill rom for local processing
-        rom[i] = FetchCell(i*4);        // read through the VM's debug interface
+    ROMchanged = 0;
+    romSize = size;
+    romUsed = i+1;
+    if (ShakeROM && (size == ROMsize)) {
+        romSize = 0;
+        romUsed = TreeShake(i+1);
     }
-    i = size;
-    while (--i) {
-        if (rom[i] != 0xFFFFFFFF) break; // find the last non-blank word
+    return romUsed;
+}
+
+// Buffered text output for the ROM dumps, formatted without printf
+
+static const char HexDigits[] = "0123456789ABCDEF";
+static FILE * OutFile;
+static char OutBuf[4096];
+static int OutLen;
+
+static void OutFlush (void) {
+    fwrite(OutBuf, 1, OutLen, OutFile);
+    OutLen = 0;
+}
+
+static void OutStr (const char *s) {
+    while (*s) {
+        if (OutLen == sizeof(OutBuf)) OutFlush();
+        OutBuf[OutLen++] = *s++;
     }
-    return i+1;
+}
+
+static void OutHex (uint32_t x, int digits) {   // at least digits wide
+    char s[9];
+    int i = 8;
+    s[8] = 0;
+    do {
+        s[--i] = HexDigits[x & 15];
+        x >>= 4;
+    } while ((x) || ((8 - i) < digits));
+    OutStr(&s[i]);
+}
+
+static void OutDec (uint32_t x, int width) {    // right-justified
+    char s[11];
+    int i = 10;
+    s[10] = 0;
+    do {
+        s[--i] = '0' + (x % 10);
+        x /= 10;
+    } while (x);
+    while ((10 - i) < width) s[--i] = ' ';
+    OutStr(&s[i]);
 }
 
 // Copy from file to file while translating embedded macros to output text.
@@ -54,6 +295,7 @@ void MakeFromTemplate(char *infile, char *outfile) {
         return;
     }
     uint32_t length;
+    OutFile = ofp;
     char buffer[256];
     int C_Columns;
     while(fgets(buffer, 255, (FILE*) ifp)) {
@@ -76,7 +318,6 @@ case 1: fprintf(ofp, "%s", GetTime());  // 1: time and date
     break;
 case 2:                                 // 2: non-blank words in ROM
     fprintf(ofp, "%d", ROMwords(ROMsize));
-    free(rom);  rom = NULL;
     break;
 case 3: fprintf(ofp, "%d", ROMsize);    // 3: words in ROM space
     break;
@@ -89,67 +330,66 @@ case 10:                                // 10: C syntax internal ROM dump
     length = ROMwords(ROMsize);
     for (int i=0; i<length; i++) {
         if (i % C_Columns) {
-            fprintf(ofp, " ");
+            OutStr(" ");
         } else {
-            fprintf(ofp, "\n/*%04X*/ ", i);
+            OutStr("\n/*");  OutHex(i, 4);  OutStr("*/ ");
         }
-        fprintf(ofp, "0x%08X", rom[i]);
+        OutStr("0x");  OutHex(rom[i], 8);
         if (i != (length-1)) {
-            fprintf(ofp, ",");
+            OutStr(",");
         }
     }
-    free(rom);  rom = NULL;
+    OutFlush();
     break;
 case 11:                                // 11: Assembler syntax internal ROM dump
     length = ROMwords(ROMsize);
-    char * directive = ".word";
-    char * format = "0x%08X";
     C_Columns = 6;
-//dumpasm:
     for (int i=0; i<length; i++) {
         int col = i % C_Columns;
         if (!col) {
-            fprintf(ofp, "\n%s ", directive);
+            OutStr("\n.word ");
         }
-        fprintf(ofp, format, rom[i]);
+        OutStr("0x");  OutHex(rom[i], 8);
         if ((i != (length-1)) && (col != (C_Columns-1))) {
-            fprintf(ofp, ",");
+            OutStr(",");
         }
     }
-    fprintf(ofp, "\n");
-    free(rom);  rom = NULL;
+    OutStr("\n");
+    OutFlush();
     break;
 case 12:                                // 12: Assembler syntax for 8051
     length = ROMwords(ROMsize);
-    directive = "DB";
-    format = "0%02XH,0%02XH,0%02XH,0%02XH";  // Little-endian format
     C_Columns = 6;
     for (int i=0; i<length; i++) {
         int col = i % C_Columns;
         if (!col) {
-            fprintf(ofp, "\n%s ", directive);
+            OutStr("\nDB ");
+        }
+        for (int j=0; j<32; j+=8) {     // Little-endian format
+            OutStr(j ? ",0" : "0");  OutHex((rom[i] >> j) & 0xFF, 2);  OutStr("H");
         }
-        fprintf(ofp, format, rom[i]&0xFF, (rom[i]>>8)&0xFF, (rom[i]>>16)&0xFF, (rom[i]>>24)&0xFF);
         if ((i != (length-1)) && (col != (C_Columns-1))) {
-            fprintf(ofp, ", ");
+            OutStr(", ");
         }
     }
-    fprintf(ofp, "\n");
-    free(rom);  rom = NULL;
+    OutStr("\n");
+    OutFlush();
     break;
 case 13:                                // 13: VHDL syntax internal ROM dump
     length = ROMwords(ROMsize);
     for (int i=0; i<length; i++) {
-        fprintf(ofp, "      when %3d => data_o <= x\"%08X\";\n", i, rom[i]);
+        OutStr("      when ");  OutDec(i, 3);
+        OutStr(" => data_o <= x\"");  OutHex(rom[i], 8);  OutStr("\";\n");
     }
-    free(rom);  rom = NULL;
+    OutFlush();
     break;
 case 14:                                // 14: Alternate VHDL ROM syntax
     length = ROMwords(ROMsize);
     for (int i=0; i<length; i++) {
-        fprintf(ofp, "    mem(%d) := x\"%08X\";\n", i, rom[i]);
+        OutStr("    mem(");  OutDec(i, 0);
+        OutStr(") := x\"");  OutHex(rom[i], 8);  OutStr("\";\n");
     }
-    free(rom);  rom = NULL;
+    OutFlush();
     break;
 case 20:                                // 20: C syntax stepping
     MakeTestVectors(ofp, PopNum(), 1);
@@ -187,55 +427,149 @@ Includes Internal ROM data and Flash data.
 This is useful for programming SPI flash devices for use with
 FPGA-based systems with RAM-based internal ROM.
 Intel HEX format (.mcs or .hex) seems the most universal.
+Sparse output leaves blank cells out, since erased memory is already blank.
 */
 
+static int Sparse;                      // skip blank cells in the output
+
+// Format one record in a local buffer and write it with a single fwrite.
+
+static void PutHexRecord (FILE *fp, int type, uint32_t offset,
+                          const uint8_t *data, int length) {
+    char buf[(4 + 255 + 1)*2 + 2];      // ':', fields, data, checksum, '\n'
+    uint8_t fields[4] = {length, offset >> 8, offset, type};
+    unsigned int checksum = 0;
+    char *p = buf;
+    *p++ = ':';
+    for (int i=0; i<4; i++) {
+        *p++ = HexDigits[fields[i] >> 4];
+        *p++ = HexDigits[fields[i] & 15];
+        checksum += fields[i];
+    }
+    for (int i=0; i<length; i++) {
+        *p++ = HexDigits[data[i] >> 4];
+        *p++ = HexDigits[data[i] & 15];
+        checksum += data[i];
+    }
+    checksum = 0xFF & -checksum;
+    *p++ = HexDigits[checksum >> 4];
+    *p++ = HexDigits[checksum & 15];
+    *p++ = '\n';
+    fwrite(buf, 1, p - buf, fp);
+}
+
 void GenHex (uint32_t begin, uint32_t end, FILE *fp) {
     uint32_t addr = begin;              // address is cell index
     unsigned int upper = 0;             // upper 16 bits of current address range
+    uint8_t data[16];
     while (addr < end) {
-        unsigned int checksum;
+        if (Sparse && (rom[addr] == 0xFFFFFFFF)) {
+            addr++;                     // blank cells are left erased
+            continue;
+        }
         unsigned int ahi = addr >> 14;
-        uint8_t hi, lo;
         if (upper != ahi) {             // Extended Linear Address
             upper = ahi;
-            hi = ahi >> 8;
-            lo = ahi & 0xFF;
-            checksum = 6+hi+lo;
-            fprintf(fp, ":02000004%02X%02X%02X\n", hi, lo, 0xFF & -checksum);
+            data[0] = ahi >> 8;
+            data[1] = ahi & 0xFF;
+            PutHexRecord(fp, 4, 0, data, 2);
         }
         int cells = end - addr;         // cells left to output
         if (cells > 4) {
             cells = 4;
         }
-        hi = (uint8_t)(addr >> 6);
-        lo = (addr*4) & 0xFF;
-        checksum = hi+lo+(cells*4);   // data record
-        fprintf(fp, ":%02X%02X%02X00", (cells*4), hi, lo);
+        if (cells > (0x4000 - (addr & 0x3FFF))) {
+            cells = 0x4000 - (addr & 0x3FFF);  // don't cross a 64K boundary
+        }
+        if (Sparse) {                   // end the record at a blank cell
+            for (int i=1; i<cells; i++) {
+                if (rom[i+addr] == 0xFFFFFFFF) {
+                    cells = i;
+                    break;
+                }
+            }
+        }
         for (int i=0; i<cells; i++) {
             uint32_t x = rom[i+addr];
-            for (int i = 0; i < 4; i++) {   // unpack little-endian
-                uint8_t b = (uint8_t)(x >> (8 * i));
-                fprintf(fp, "%02X", b);
-                checksum += b;
+            for (int j = 0; j < 4; j++) {   // unpack little-endian
+                data[i*4 + j] = (uint8_t)(x >> (8 * j));
             }
         }
-        fprintf(fp, "%02X\n", 0xFF & -checksum);
+        PutHexRecord(fp, 0, addr*4, data, cells*4);
         addr += cells;
     }
 }
 
 /* Save in Free Model Foundry byte-wide format */
 void GenFMF (uint32_t begin, uint32_t end, FILE *fp) {
-    fprintf(fp, "@%06X\n", begin << 2);
+    int skipped = 1;                    // an address line is needed
+    OutFile = fp;
     for (int i=begin; i<end; i++) {
         uint32_t x = rom[i];
-        for (int i = 0; i < 4; i++) {   // unpack little-endian
-            uint8_t b = (uint8_t)(x >> (8 * i));
-            fprintf(fp, "%02X\n", b);
+        if (Sparse && (x == 0xFFFFFFFF)) {
+            skipped = 1;
+            continue;
         }
+        if (skipped) {
+            OutStr("@");  OutHex(i << 2, 6);  OutStr("\n");
+            skipped = 0;
+        }
+        for (int j = 0; j < 4; j++) {   // unpack little-endian
+            OutHex((x >> (8 * j)) & 0xFF, 2);  OutStr("\n");
+        }
+    }
+    OutFlush();
+}
+
+/*
+Save in run-length binary format, for saving and restoring the simulator's
+own memory. The file starts with ImageMagic, followed by extents:
+    cell address, count, cells
+A count with bit 31 set is a run: one cell repeated (count & 0x7FFFFFFF)
+times. Otherwise count cells follow. Blank cells are never stored.
+A zero count ends the image. Cells are in host byte order, like "-o" files.
+*/
+
+static const char ImageMagic[4] = {'T','i','f','R'};
+#define MinRepeat 3                     // shorter runs are stored as cells
+
+static uint32_t RepeatLength (uint32_t addr, uint32_t end) {
+    uint32_t n = 1;
+    while (((addr + n) < end) && (rom[addr + n] == rom[addr])) n++;
+    return n;
+}
+
+void GenRLE (uint32_t begin, uint32_t end, FILE *fp) {
+    uint32_t addr = begin;
+    while (addr < end) {
+        if (rom[addr] == 0xFFFFFFFF) {
+            addr++;
+            continue;
+        }
+        uint32_t extent[2] = {addr, RepeatLength(addr, end)};
+        if (extent[1] >= MinRepeat) {
+            addr += extent[1];
+            extent[1] |= 0x80000000;
+            fwrite(extent, sizeof(uint32_t), 2, fp);
+            fwrite(&rom[extent[0]], sizeof(uint32_t), 1, fp);
+            continue;
+        }
+        uint32_t n = 1;                 // collect cells up to a blank or run
+        while (((addr + n) < end) && (rom[addr + n] != 0xFFFFFFFF)
+            && (RepeatLength(addr + n, end) < MinRepeat)) n++;
+        extent[1] = n;
+        fwrite(extent, sizeof(uint32_t), 2, fp);
+        fwrite(&rom[addr], sizeof(uint32_t), n, fp);
+        addr += n;
     }
 }
 
+/*
+flags: bit 0 = include internal ROM, bit 1 = include flash memory,
+       bit 2 = FMF format, bit 3 = sparse, bit 4 = run-length binary format
+Tree shaking also makes the output sparse.
+*/
+
 void SaveHexImage (int flags, char *filename) {
     int32_t length;
     WipeTIB();                          // don't need to see TIB contents
@@ -245,76 +579,196 @@ void SaveHexImage (int flags, char *filename) {
         tiffIOR = -198;                 // Can't create output file
         return;
     }
+    void (*gen)(uint32_t begin, uint32_t end, FILE *fp) = GenHex;
+    if (flags & 4) {
+        gen = GenFMF;
+    }
+    if (flags & 16) {
+        gen = GenRLE;
+        fwrite(ImageMagic, 1, 4, ofp);
+    }
+    Sparse = (flags & 8) || ShakeROM;
     if (flags & 1) {                    // bit 0 = include internal ROM
         length = ROMwords(ROMsize);
-        if (flags & 4) {
-            GenFMF(0, length, ofp);
-        } else {
-            GenHex(0, length, ofp);
-        }
+        gen(0, length, ofp);
     }
     if (flags & 2) {                    // bit 1 = include flash memory
         length = ROMwords(SPIflashBlocks<<10);
-        if (flags & 4) {
-            GenFMF(ROMsize+RAMsize, length, ofp);
-        } else {
-            GenHex(ROMsize+RAMsize, length, ofp);
-        }
+        gen(ROMsize+RAMsize, length, ofp);
     }
-    if (!(flags & 4)) {
-        fputs(":00000001FF\n", ofp);    // EOF marker
+    if (flags & 16) {
+        uint32_t extent[2] = {0, 0};
+        fwrite(extent, sizeof(uint32_t), 2, ofp);
+    } else if (!(flags & 4)) {
+        PutHexRecord(ofp, 1, 0, NULL, 0);   // EOF marker
     }
     fclose(ofp);
-    free(rom);  rom = NULL;
+}
+
+// Save binary test vectors for the C testbench, see MakeTestVectors.
+
+void SaveTestVectors (int length, char *filename) {
+    FILE *ofp;
+    ofp = fopen(filename, "wb");
+    if (ofp == NULL) {
+        tiffIOR = -198;                 // Can't create output file
+        return;
+    }
+    MakeTestVectors(ofp, length, 3);
+    fclose(ofp);
 }
 
 /*
-    Load to ROM image (using StoreROM) in hex format
+    Load to ROM image in hex format.
+    The whole file is read at once and decoded with a lookup table.
+    Each record's checksum is checked. Data is collected into runs of
+    consecutive cells, which are programmed into ROM and flash by StoreROMs.
+    A run-length binary image (see GenRLE) is also accepted.
 */
 
-static int NextHexByte(FILE *fp) {
-    unsigned int ch = fgetc(fp);  if (EOF == ch) return -1;
-    unsigned int cl = fgetc(fp);  if (EOF == cl) return -1;
-    ch -= '0';  if(ch>9) ch-= 7;
-    cl -= '0';  if(cl>9) cl-= 7;
-    return (16*ch) + cl;
+#define HexRunCells 4096                // cells per StoreROMs call
+
+static int8_t HexValue[256];            // digit value, -1 if not a hex digit
+
+static void HexTable (void) {
+    memset(HexValue, -1, sizeof(HexValue));
+    for (int i=0; i<10; i++) HexValue['0' + i] = i;
+    for (int i=0; i<6; i++) {
+        HexValue['A' + i] = 10 + i;
+        HexValue['a' + i] = 10 + i;
+    }
+}
+
+static uint32_t * HexRun;               // cells waiting to be stored
+static uint32_t HexRunAddr;             // byte address of HexRun[0]
+static int HexRunLength;
+
+static void FlushHexRun (void) {
+    if (HexRunLength) {
+        StoreROMs(HexRun, HexRunAddr, HexRunLength);
+    }
+    HexRunLength = 0;
+}
+
+static void LoadRLE (uint8_t *text, long size, char *filename) {
+    uint32_t *p = (uint32_t*) (text + 4);
+    uint32_t *end = (uint32_t*) (text + (size & ~3));
+    while ((p + 2) <= end) {
+        uint32_t addr = p[0];
+        uint32_t n = p[1];
+        p += 2;
+        if (!n) return;                 // end of image
+        if (n & 0x80000000) {           // one cell repeated
+            if (p == end) break;
+            uint32_t fill[64];
+            for (int i=0; i<64; i++) fill[i] = *p;
+            p++;
+            n &= 0x7FFFFFFF;
+            while (n) {
+                uint32_t m = (n < 64) ? n : 64;
+                StoreROMs(fill, addr*4, m);
+                addr += m;  n -= m;
+            }
+        } else {
+            if (n > (uint32_t)(end - p)) break;
+            StoreROMs(p, addr*4, n);
+            p += n;
+        }
+    }
+    printf("\nTruncated image file %s ", filename);
+    tiffIOR = -195;                     // Can't read file
 }
 
 void LoadHexImage (char *filename) {
-    if (filename) {                     // hex file exists, overwrite everything
-        FILE *fp;
-        fp = fopen(filename, "r");
-        if (fp) {
-            while (1) {
-                uint32_t addr = 0;
-                int c;
-                do {
-                    c = fgetc(fp);
-                    if (EOF == c) goto eof;
-                } while (c != ':');         // skip to next ':'
-                int length = NextHexByte(fp);
-                int value = (NextHexByte(fp) << 8) + NextHexByte(fp);
-                int cmd = NextHexByte(fp);
-                uint32_t x = 0;
-                switch(cmd) {
-                    case 4: addr = (addr & 0xFFFF) + (value << 16);
-                        break;
-                    case 0: addr = (addr & 0xFFFF0000) + value;
-                        for (int i=0; i<(length/4); i++) {
-                            x  = NextHexByte(fp);
-                            x += NextHexByte(fp) << 8;
-                            x += NextHexByte(fp) << 16;
-                            x += NextHexByte(fp) << 24;
-                            StoreROM(x, addr);
-                            addr += 4;
-                        }
-                        break;
-                    default: break;
+    if (!filename) return;              // no hex file, leave memory blank
+    FILE *fp;
+    fp = fopen(filename, "rb");
+    if (fp == NULL) {                   // couldn't open file
+        printf("Missing HEX file %s\n", filename);
+        return;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < 0) {                     // not a seekable file
+        fclose(fp);
+        printf("\nCan't size HEX file %s ", filename);
+        tiffIOR = -37;                  // File I/O exception
+        return;
+    }
+    uint8_t *text = (uint8_t*) malloc(size + 1);
+    if (text == NULL) {
+        fclose(fp);
+        tiffIOR = -100;                 // ALLOCATE failed
+        return;
+    }
+    size = fread(text, 1, size, fp);
+    fclose(fp);
+    if ((size >= 4) && !memcmp(text, ImageMagic, 4)) {
+        LoadRLE(text, size, filename);
+        free(text);
+        return;
+    }
+    HexTable();
+    HexRun = (uint32_t*) malloc(HexRunCells * sizeof(uint32_t));
+    if (HexRun == NULL) {
+        free(text);
+        tiffIOR = -100;                 // ALLOCATE failed
+        return;
+    }
+    uint8_t rec[4 + 255 + 1];           // length, offset, type, data, checksum
+    uint32_t base = 0;                  // extended address
+    int records = 0;
+    uint8_t *p = text;
+    uint8_t *end = text + size;
+    while (p < end) {
+        if (*p++ != ':') continue;      // skip to next ':'
+        records++;
+        int n = 0;
+        while (((p + 1) < end) && (n < (int)sizeof(rec))) {
+            int hi = HexValue[p[0]];
+            int lo = HexValue[p[1]];
+            if ((hi < 0) || (lo < 0)) break;
+            rec[n++] = (hi << 4) + lo;
+            p += 2;
+        }
+        uint8_t checksum = 0;
+        for (int i=0; i<n; i++) checksum += rec[i];
+        if ((n < 5) || (n != (rec[0] + 5)) || checksum) {
+            printf("\nBad record %d in HEX file %s ", records, filename);
+            tiffIOR = -195;             // Can't read file
+            break;
+        }
+        uint32_t offset = (rec[1] << 8) + rec[2];
+        int length = rec[0];
+        int type = rec[3];
+        if (type == 1) break;           // EOF
+        switch (type) {
+            case 0: offset += base;     // data
+                if ((offset | length) & 3) {
+                    tiffIOR = -23;      // cells only
+                    break;
                 }
-            }
-eof:        fclose(fp);
-        } else {                        // couldn't open file
-            printf("Missing HEX file %s\n", filename);
+                for (int i=0; i<length; i+=4) {
+                    uint32_t x = rec[4+i] + (rec[5+i] << 8)
+                               + (rec[6+i] << 16) + ((uint32_t)rec[7+i] << 24);
+                    if ((HexRunLength == HexRunCells)
+                     || (offset != (HexRunAddr + HexRunLength*4))) {
+                        FlushHexRun();
+                    }
+                    if (!HexRunLength) HexRunAddr = offset;
+                    HexRun[HexRunLength++] = x;
+                    offset += 4;
+                }
+                break;
+            case 2: base = ((rec[4] << 8) + rec[5]) << 4;
+                break;                  // Extended Segment Address
+            case 4: base = ((rec[4] << 8) + rec[5]) << 16;
+                break;                  // Extended Linear Address
+            default: break;
         }
     }
+    FlushHexRun();
+    free(HexRun);  HexRun = NULL;
+    free(text);
 }
@@ -9,5 +9,8 @@
 void MakeFromTemplate (char *infile, char *outfile);
 void SaveHexImage (int flags, char *filename);   // save ROM/flash image to file
 void LoadHexImage (char *filename);
+void SaveTestVectors (int length, char *filename);  // binary test vectors
+void ShakeRoot (uint32_t xt);       // keep this definition when tree shaking
+extern int ShakeROM;               // remove unreachable code from ROM images
 
 #endif // __FILEIO_H__
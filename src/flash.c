@@ -4,6 +4,9 @@
 #include "config.h"
 #include "vm.h"
 #include "flash.h"
+#ifdef TRACEABLE
+#include "timeline.h"
+#endif // TRACEABLE
 //`0`#define ROMsize `3`
 //`0`#define RAMsize `4`
 //`0`#define SPIflashBlocks `5`
@@ -12,7 +15,7 @@
 #define FLASHCELLS (SPIflashBlocks<<10)
 
 /*
-   Exports: FlashInit, SPIflashXfer, FlashRead, FlashWrite, FlashBye
+   Exports: FlashInit, SPIflashXfer, FlashRead, FlashWrite, FlashProgram, FlashBye
    Addresses are VM byte addresses
 */
 
@@ -55,6 +58,32 @@ void FlashBye (char * filename) {
     free(FlashMem);
 };
 
+#ifdef TRACEABLE
+// Read latency of a memory-mapped SPI flash. A random read sends the 0Bh
+// command, a 24-bit address and a dummy byte before clocking in 32 bits.
+// Reading the next cell continues the burst, so it only clocks the data.
+// Address and data use SPIlanes lines: 1 for standard SPI, 4 for quad SPI.
+
+uint32_t SPIclockMHz = 25;
+int SPIlanes = 1;
+uint64_t FlashClocks;                   // SPI clocks spent reading
+int FlashTimed;                         // VM or header search, not debug peeks
+uint32_t FlashReads[2];                 // random, sequential
+static int32_t LastFlashCell = -1;
+
+static void FlashLatency (int32_t a) {
+    if (a == LastFlashCell) return;     // another byte of the same cell
+    if (a == (LastFlashCell + 1)) {
+        FlashClocks += 32 / SPIlanes;
+        FlashReads[1]++;
+    } else {
+        FlashClocks += 8 + 8 + (24 + 32) / SPIlanes;
+        FlashReads[0]++;
+    }
+    LastFlashCell = a;
+}
+#endif // TRACEABLE
+
 uint32_t FlashRead (uint32_t addr) {
     int32_t a = (addr >> 2) - BASEADDR;
     if (a < 0) {
@@ -63,6 +92,9 @@ uint32_t FlashRead (uint32_t addr) {
     if (a >= FLASHCELLS) {
         return -1;
     }
+#ifdef TRACEABLE
+    if (FlashTimed) FlashLatency(a);
+#endif // TRACEABLE
     return FlashMem[a];
 };
 
@@ -89,9 +121,29 @@ int FlashWrite (uint32_t x, uint32_t addr) {
         return -60;              	// not erased
     }
     FlashMem[a] = old & x;
+    ROMchanged = 1;
     return 0;
 };
 
+// Program a block of cells. Unlike FlashWrite, a cell that isn't erased is
+// still programmed: like a real part, its bits are ANDed in. Returns -60 then.
+
+int FlashProgram (const uint32_t *src, uint32_t addr, int cells) {
+    int32_t a = (addr >> 2) - BASEADDR;
+    if ((a < 0) || ((a + cells) > FLASHCELLS)) {
+        return -9;
+    }
+    int ior = 0;
+    uint32_t *dest = &FlashMem[a];
+    ROMchanged = 1;
+    while (cells--) {
+        uint32_t x = *src++;
+        if (~(*dest | x)) ior = -60;    // not erased
+        *dest++ &= x;
+    }
+    return ior;
+};
+
 
 /*------------------------------------------------------------------------------
 | Name   | Hex | Command                           |
@@ -153,6 +205,11 @@ uint32_t SPIflashXfer (uint32_t n) {    /*EXPORT*/
 				case 7: addr += cin<<8;  					state++;  break;
 				case 8: addr += cin;
                     if (addr < (SPIflashBlocks<<12)) {
+#ifdef TRACEABLE
+                        if (Timeline && ((command == 0x02) || ((command == 0x20) && wen))) {
+                            TimelineEvent(TimelineFlash, addr, command);
+                        }
+#endif // TRACEABLE
                         switch (command) {
                             case 0x20: if (wen) tiffIOR = Erase4K(addr); // erase sector
                                 wen=0; /* 4K erase */		state=1;  break;
@@ -8,8 +8,17 @@ void FlashInit (char * filename);
 void FlashBye  (char * filename);
 uint32_t FlashRead (uint32_t addr);
 int FlashWrite (uint32_t x, uint32_t addr);
+int FlashProgram (const uint32_t *src, uint32_t addr, int cells);
 uint32_t SPIflashXfer (uint32_t n);
 
+#ifdef TRACEABLE
+extern uint32_t SPIclockMHz;            // SPI flash read latency model
+extern int SPIlanes;
+extern uint64_t FlashClocks;
+extern uint32_t FlashReads[2];          // random, sequential
+extern int FlashTimed;                  // reads are charged to the above
+#endif // TRACEABLE
+
 extern char * LoadFlashFilename;
 
 #endif // __FLASH_H__
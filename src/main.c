@@ -8,6 +8,7 @@
 #include "fileio.h"
 #include <string.h>
 #include "vmhost.h"
+#include "vmUser.h"
 #define HP0max  (MaxROMsize - 0x1000)
 
 /*global*/ int HeadPointerOrigin = (ROMsizeDefault + RAMsizeDefault)*4;
@@ -18,6 +19,7 @@ static     int  testmode = 0;
 
 void TidyUp (void) {                    // stuff to do at exit
     ROMbye();
+    AXIbye();
     FlashBye(SaveFlashFilename);
 #ifdef TRACEABLE
     DestroyTrace();                     // free the trace buffer
@@ -89,6 +91,16 @@ nextarg:
                     if (argc == Arg) goto splain;
                     SPIflashBlocks = Number(argv[Arg++], MaxFlashCells >> 10, 's');
                     goto nextarg;
+                case 'a':
+                    if (argc == Arg) goto splain;
+                    AXIsize = Number(argv[Arg++], MaxAXIsize, 'a');
+                    goto nextarg;
+#ifdef TRACEABLE
+                case 'p':
+                    if (argc == Arg) goto splain;
+                    VMtimeslice(Number(argv[Arg++], 0x7FFFFFFF, 'p'));
+                    goto nextarg;
+#endif // TRACEABLE
                 case 'i':
                     if (argc == Arg) goto splain;
                     LoadFlashFilename = argv[Arg++];
@@ -117,6 +129,10 @@ splain:             printf("Format: [cmds] [\"Forth Command Line\"]\n");
                     printf("-m <n>         Change ROM size from {0x%X} cells\n",         ROMsizeDefault);
                     printf("-s <n>         Change stack region from {0x%X} cells\n",     StackSpace);
                     printf("-b <n>         Change SPI flash 4k block count from {%d}\n", FlashBlksDefault);
+                    printf("-a <n>         Change AXI space from {0x%X} cells\n",       AXIsizeDefault);
+#ifdef TRACEABLE
+                    printf("-p <n>         Time-slice interrupt every n cycles\n");
+#endif // TRACEABLE
                     printf("-i <filename>  Initialize flash image from file\n");
                     printf("-o <filename>  Save flash image upon exit\n");
                     printf("-c [filename]  Hex file for cold booting (note save-hex)\n");
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "vm.h"
+#include "vmUser.h"
+#include "periph.h"
+
+#if _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+// Stand-in peripherals for the vmIO bus, and loading of peripheral plugins.
+// Register offsets are bus addresses from the device base: even offsets are
+// reads, odd offsets are writes. Data is 16-bit going in, up to 32-bit out.
+
+static struct vmPeripheral * NewDevice(char *name, unsigned int base,
+        unsigned int size, vmIOfn read, vmIOfn write,
+        void (*tick)(void *ctx, uint32_t cycles), size_t ctxsize) {
+    struct vmPeripheral *p = malloc(sizeof(struct vmPeripheral));
+    if (p == NULL) return NULL;
+    p->name = name;  p->base = base;  p->size = size;
+    p->read = read;  p->write = write;  p->tick = tick;
+    p->ctx = calloc(1, ctxsize);
+    if (p->ctx == NULL) {
+        free(p);  return NULL;
+    }
+    return p;
+}
+
+// Devices that can interrupt have a register for their IRQ line. Line 0 is
+// the time slice, so writing 0 means no interrupt. The interrupt controller
+// is only in a TRACEABLE VM.
+
+#ifdef TRACEABLE
+static int Raise (int line, uint32_t ago) {
+    return VMirq(line, ago);
+}
+#else
+static int Raise (int line, uint32_t ago) {
+    return -21;                         // unsupported operation
+}
+#endif // TRACEABLE
+
+// Timer: counts VM clock cycles down from a 16-bit period, then reloads.
+// 0: count   1: set period and restart, 0 stops   2: expired flag, clears
+// 3: IRQ line raised when it expires
+
+struct Timer {
+    uint32_t count, period, expired, irq;
+};
+
+static uint32_t TimerIO (void *ctx, unsigned int reg, uint32_t data) {
+    struct Timer *t = ctx;
+    uint32_t x;
+    switch (reg) {
+        case 0: return t->count;
+        case 1: t->period = t->count = data;  return 0;
+        case 2: x = t->expired;  t->expired = 0;  return x;
+        case 3: t->irq = data;  return 0;
+        default: return 0;
+    }
+}
+
+static void TimerTick (void *ctx, uint32_t cycles) {
+    struct Timer *t = ctx;
+    if (t->period == 0) return;
+    while (cycles >= t->count) {
+        cycles -= t->count;
+        t->count = t->period;
+        t->expired++;
+        if (t->irq) Raise(t->irq, cycles);
+    }
+    t->count -= cycles;
+}
+
+// DMA engine: copies RAM cells at one cell per clock cycle.
+// 0: cells left to copy   1: source cell   3: destination cell
+// 5: cell count, starts the copy   7: IRQ line raised when done
+
+struct DMA {
+    uint32_t src, dest, count, irq;
+};
+
+static uint32_t DMAio (void *ctx, unsigned int reg, uint32_t data) {
+    struct DMA *d = ctx;
+    switch (reg) {
+        case 0: return d->count;
+        case 1: d->src = data;  break;
+        case 3: d->dest = data;  break;
+        case 5: d->count = data;  break;
+        case 7: d->irq = data;  break;
+        default: break;
+    }
+    return d->count;
+}
+
+static void DMAtick (void *ctx, uint32_t cycles) {
+    struct DMA *d = ctx;
+    while (d->count && cycles--) {
+        int32_t src  = ((d->src++  & (RAMsize-1)) - RAMsize) * 4;
+        int32_t dest = ((d->dest++ & (RAMsize-1)) - RAMsize) * 4;
+        StoreCell(FetchCell(src), dest);
+        if ((--d->count == 0) && d->irq) Raise(d->irq, cycles);
+    }
+}
+
+// Packet FIFO: a loopback network interface. Words written are collected
+// into a packet until it is sent, then read back a packet at a time.
+// 0: packets waiting   2: words left in the front packet   4: pop a word
+// 1: push a word       3: send the packet                  5: clear
+// 7: IRQ line raised when a packet arrives
+
+#define FIFOwords    1024
+#define FIFOpackets  64
+
+struct FIFO {
+    uint16_t data[FIFOwords];
+    uint16_t length[FIFOpackets];       // of each packet sent
+    int head, tail, open;               // word pointers, words in open packet
+    int first, packets;                 // front packet, packets waiting
+    int irq;
+};
+
+static uint32_t FIFOio (void *ctx, unsigned int reg, uint32_t data) {
+    struct FIFO *f = ctx;
+    int words = f->head - f->tail;
+    switch (reg) {
+        case 0: return f->packets;
+        case 1:
+            if (words == FIFOwords) return 0;   // full, the word is lost
+            f->data[f->head++ % FIFOwords] = data;
+            f->open++;
+            return 1;
+        case 2: return f->packets ? f->length[f->first] : 0;
+        case 3:
+            if (f->packets == FIFOpackets) return 0;
+            f->length[(f->first + f->packets++) % FIFOpackets] = f->open;
+            f->open = 0;
+            if (f->irq) Raise(f->irq, 0);
+            return 1;
+        case 4:
+            if (f->packets == 0) return 0;
+            if (f->length[f->first] == 0) return 0;
+            data = f->data[f->tail++ % FIFOwords];
+            if (--f->length[f->first] == 0) {
+                f->first = (f->first + 1) % FIFOpackets;
+                f->packets--;
+            }
+            return data;
+        case 5:
+            data = f->irq;
+            memset(f, 0, sizeof(struct FIFO));
+            f->irq = data;
+            return 0;
+        case 7: f->irq = data;  return 0;
+        default: return 0;
+    }
+}
+
+#ifdef TRACEABLE
+// Interrupt controller, see vm.c. Each line is a bit.
+// 0: pending      2: in service          4: enabled      6: vector base
+// 1: enable       3: end of interrupt    5: raise        7: vector base
+// 8: latency of the last interrupt, in cycles            9: clear pending
+
+static uint32_t IntcIO (void *ctx, unsigned int reg, uint32_t data) {
+    switch (reg) {
+        case 0: return IRQpending;
+        case 1: IRQenable = data;  return 0;
+        case 2: return IRQinService;
+        case 3: VMeoi();  return 0;
+        case 4: return IRQenable;
+        case 5:
+            for (int i = 0; i < IRQlines; i++) {
+                if (data & (1u << i)) VMirq(i, 0);
+            }
+            return 0;
+        case 6: return IRQbase;
+        case 7: IRQbase = data;  return 0;
+        case 8: return IRQlatency;
+        case 9: IRQpending &= ~data;  return 0;
+        default: return 0;
+    }
+}
+#endif // TRACEABLE
+
+int AddPeripheral(char *name, unsigned int base) {
+    struct vmPeripheral *p;
+    if (!strcmp(name, "timer")) {
+        p = NewDevice("timer", base, 4, TimerIO, TimerIO, TimerTick,
+                      sizeof(struct Timer));
+    } else if (!strcmp(name, "dma")) {
+        p = NewDevice("dma", base, 8, DMAio, DMAio, DMAtick,
+                      sizeof(struct DMA));
+    } else if (!strcmp(name, "fifo")) {
+        p = NewDevice("fifo", base, 8, FIFOio, FIFOio, NULL,
+                      sizeof(struct FIFO));
+#ifdef TRACEABLE
+    } else if (!strcmp(name, "intc")) {
+        p = NewDevice("intc", base, 10, IntcIO, IntcIO, NULL, 1);
+#endif // TRACEABLE
+    } else {
+        return -13;                     // undefined word
+    }
+    if (p == NULL) return -100;         // ALLOCATE failed
+    return vmIOregister(p);
+}
+
+// Plugins get the VM's memory through the host structure, so they don't
+// have to link against tiff.
+
+static void *Symbol(void *lib, char *name) {
+#if _WIN32
+    return (void *)GetProcAddress((HMODULE)lib, name);
+#else
+    return dlsym(lib, name);
+#endif
+}
+
+static void LoadError(char *filename) {
+#if _WIN32
+    printf("\n%s: error %lu", filename, (unsigned long)GetLastError());
+#else
+    printf("\n%s", dlerror());
+#endif
+}
+
+int LoadPeripheral(char *filename, unsigned int base) {
+    static struct vmPluginHost host;
+    host.Register = vmIOregister;
+    host.FetchCell = FetchCell;
+    host.StoreCell = StoreCell;
+    host.RAMsize = RAMsize;
+    host.Interrupt = Raise;
+    host.Opcode = XopDefine;
+#if _WIN32
+    void *lib = (void *)LoadLibraryA(filename);
+#else
+    void *lib = dlopen(filename, RTLD_NOW | RTLD_LOCAL);
+#endif
+    if (lib == NULL) {
+        LoadError(filename);
+        return -199;                    // can't open file
+    }
+    int (*init)(struct vmPluginHost *host, unsigned int base);
+    *(void **)(&init) = Symbol(lib, "vmPluginInit");
+    if (init == NULL) {
+        printf("\nvmPluginInit is missing");
+        return -199;
+    }
+    return init(&host, base);           // the library stays loaded
+}
+
+void ListPeripherals(void) {
+    struct vmPeripheral *last = NULL;
+    for (unsigned int i = 0; i < IOaddresses; i++) {
+        struct vmPeripheral *p = vmIOdevice(i);
+        if (p && (p != last)) {
+            printf("\n%03X %-12s %d addresses%s", i, p->name, p->size,
+                   p->tick ? ", ticks" : "");
+        }
+        last = p;
+    }
+}
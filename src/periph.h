@@ -0,0 +1,26 @@
+//===============================================================================
+// periph.h
+//===============================================================================
+#ifndef __PERIPH_H__
+#define __PERIPH_H__
+#include "vmUser.h"
+#include "xop.h"
+
+// A peripheral plugin is a shared object that exports
+//   int vmPluginInit(struct vmPluginHost *host, unsigned int base);
+// It registers its devices at or above base and returns 0 or an ior.
+// It may also define experimental opcodes: Opcode returns the opcode or an ior.
+struct vmPluginHost {
+    int (*Register)(struct vmPeripheral *p);
+    uint32_t (*FetchCell)(int32_t addr);
+    void (*StoreCell)(uint32_t x, int32_t addr);
+    uint32_t RAMsize;                   // cells
+    int (*Interrupt)(int line, uint32_t ago);   // raise an IRQ line, ior
+    int (*Opcode)(int opcode, struct vmXop *x); // experimental opcode
+};
+
+int AddPeripheral(char *name, unsigned int base);   // timer, dma, fifo, intc
+int LoadPeripheral(char *filename, unsigned int base);   // shared object
+void ListPeripherals(void);
+
+#endif // __PERIPH_H__
@@ -7,6 +7,12 @@
 #include "compile.h"
 #include "fileio.h"
 #include "colors.h"
+#include "cosim.h"
+#include "periph.h"
+#include "xop.h"
+#include "timeline.h"
+#include "flash.h"
+#include "vmUser.h"
 #include <string.h>
 #include <ctype.h>
 
@@ -222,11 +228,13 @@ void CommaHeader (char *name, uint32_t xte, uint32_t xtc, int Size, int flags){
     uint16_t LineNum = FetchHalf(LINENUMBER);               /* EXPORT */
 	uint8_t fileid = FetchByte(FILEID);
 	uint32_t   wid = FetchCell(CURRENT);                  // CURRENT -> Wordlist
-    uint32_t  link = FetchCell(wid);
+    uint32_t  head = ThreadHead(wid, HashThread(name));   // -> thread
+    uint32_t  link = FetchCell(head);
 	CommaH ((fileid << 24) | 0xFF0000 | (Size & 0xFFFF)); // [-3]: File ID | size
 	CommaH (((LineNum & 0xFF)<<24)  +  (xtc & 0xFFFFFF)); // [-2]
 	CommaH (((LineNum & 0xFF00)<<16) + (xte & 0xFFFFFF)); // [-1]
-	StoreCell (FetchCell(HP), wid);
+	StoreCell (FetchCell(HP), wid);                       // last header
+	StoreCell (FetchCell(HP), head);
 	CommaH (0xFF000000 | link);                           // [0]: spare | link
 	CompString(name, (flags<<4)+7, HP);
 }
@@ -295,9 +303,6 @@ static void PrintWordlist(uint32_t WID, char *substring, int verbosity) {
     char wordname[32];
     if (strlen(substring) == 0)         // zero length string same as NULL
         substring = NULL;
-    if (verbosity) {
-        printf("NAME             LEN    XTE    XTC FID  LINE  TAG    VALUE FLAG HEAD\n");
-    }
     uint32_t xtc, xte, tag;
     do {
         uint8_t length = FetchByte(WID+4);
@@ -346,9 +351,15 @@ done:
 
 static void tiffWords (char *substring, int verbosity) {
     uint8_t wids = FetchByte(WIDS);
+    if (verbosity) {
+        printf("NAME             LEN    XTE    XTC FID  LINE  TAG    VALUE FLAG HEAD\n");
+    }
     while (wids--) {
         uint32_t wid = FetchCell(CONTEXT + wids*4);  // search the first list
-        PrintWordlist(FetchCell(wid), substring, verbosity);
+        for (int i=0; i<WordlistThreads; i++) {
+            uint32_t ht = FetchCell(ThreadHead(wid, i));
+            if (ht) PrintWordlist(ht, substring, verbosity);
+        }
     }
     ColorNormal();
     printf("\n");
@@ -445,6 +456,7 @@ static void iword_NONAME (void) {
 static void iword_COLON (void) {
     FollowingToken(name, 32);
     NewGroup();
+    ClearWasted();
     CommaHeader(name, FetchCell(CP), ~16, -1, 0xE0);
     // xtc must be multiple of 8 ----^
     StoreByte(1, COLONDEF); // there's a header to resolve
@@ -476,6 +488,42 @@ static void iword_SaveHexImage (void) { // ( flags <filename> -- )
     FollowingToken(name, 80);           // binary image filename
     SaveHexImage(PopNum(), name);       // fileio.c
 }
+static void iword_ShakeOn (void) {     // tree-shake ROM images
+    ShakeROM = 1;
+}
+static void iword_ShakeOff (void) {
+    ShakeROM = 0;
+}
+static void iword_ShakeRoot (void) {    // ( xt -- )
+    ShakeRoot(PopNum());                // fileio.c
+}
+static void iword_Vectors (void) {      // ( length <filename> -- )
+    FollowingToken(name, 80);           // binary test vector filename
+    SaveTestVectors(PopNum(), name);    // fileio.c
+}
+#ifdef TRACEABLE
+static void iword_CoSim (void) {        // ( length <filename> -- matched )
+    FollowingToken(name, 80);           // shared library with the other VM
+    PushNum(CoSim(name, PopNum()));     // cosim.c
+}
+#endif // TRACEABLE
+static void iword_Periph (void) {       // ( base <name> -- )
+    FollowingToken(name, 32);           // timer, dma or fifo
+    tiffIOR = AddPeripheral(name, PopNum());    // periph.c
+}
+static void iword_LoadPeriph (void) {   // ( base <filename> -- )
+    FollowingToken(name, 80);           // shared library with vmPluginInit
+    tiffIOR = LoadPeripheral(name, PopNum());   // periph.c
+}
+static void iword_Xop (void) {          // ( <name> -- )
+    FollowingToken(name, 32);           // a candidate in xop.c
+    int opcode = XopCandidate(name);
+    if (opcode < 0) {
+        tiffIOR = opcode;
+    } else {
+        printf("\n%s is opcode %02o ", name, opcode);
+    }
+}
 static void iword_LitChar (void) {
     FollowingToken(name, 32);
     Literal(name[0]);
@@ -665,7 +713,7 @@ static void iword_ANON (void) {
 }
 
 
-static char *LocateFilename (int id) {  // get filename from FileID
+char *LocateFilename (int id) {  /*EXPORT*/ // get filename from FileID
     uint32_t p = HeadPointerOrigin;     // link is at the bottom of header space
     do {
         p = FetchCell(p);               // traverse to filename
@@ -704,6 +752,54 @@ static void iword_LOCATE (void) {       // locate source text
 ex: fclose(fp);
 }
 
+#ifdef TRACEABLE
+static void iword_HEAT (void) {         // LOCATE with hits and cycles per line
+    uint32_t ht = Htick();
+    if (!ht) return;
+    uint8_t fileid = FetchByte(ht-9);
+    uint16_t linenum = (FetchByte(ht-1)<<8) + FetchByte(ht-5);
+    uint32_t xte = FetchCell(ht-4) & 0xFFFFFF;
+    uint32_t length = FetchHalf(ht-12);
+    uint32_t used, last = linenum + LocateLines - 1;
+    uint32_t *map = SourceMap(&used);   // compile.c
+    if (length < 255) {                 // the definition's last line
+        last = linenum;
+        for (uint32_t i = xte/4; (i < xte/4 + length) && (i < used); i++) {
+            if (((map[i] >> 16) == fileid) && ((map[i] & 0xFFFF) > last)) {
+                last = map[i] & 0xFFFF;
+            }
+        }
+    }
+    char *filename = LocateFilename(fileid);
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) goto ex;                   // can't open file
+    SwallowBOM(fp);
+    ColorHilight();
+    printf("%s\n%8s %8s\n", filename, "hits", "cycles");
+    ColorNormal();
+    for (int i=1; i<linenum; i++) {     // skip to the definition
+        if (GetLine(name, MaxTIBsize, fp) < 0) goto done;
+    }
+    for (uint32_t line = linenum; line <= last; line++) {
+        if (GetLine(name, MaxTIBsize, fp) < 0) break;
+        uint32_t key = (fileid << 16) + line;
+        uint32_t hits = 0, cycles = 0, cells = 0;
+        for (uint32_t i=0; i<used; i++) {
+            if (map[i] != key) continue;
+            hits += ProfileCounts[i];
+            cycles += ProfileCycles[i];
+            cells++;
+        }
+        if (cells) printf("%8u %8u ", hits, cycles);
+        else printf("%18s", "");
+        printf("%-4d %s\n", line, name);
+    }
+done:
+    fclose(fp);
+ex: free(map);
+}
+#endif // TRACEABLE
+
 static void iword_DASM (void) {         // disassemble range ( addr len )
     uint32_t length = PopNum();
     uint32_t addr = PopNum();
@@ -725,6 +821,30 @@ static void iword_CPUon (void) {        // enable CPU display mode
 static void iword_CPUoff (void) {       // disable CPU display mode
     ShowCPU = 0;
 }
+static void iword_PackOn (void) {       // report wasted slots at ;
+    ShowPacking = 1;
+}
+static void iword_PackOff (void) {
+    ShowPacking = 0;
+}
+static void iword_PeepOn (void) {       // peephole optimizer
+    Optimize = 1;
+}
+static void iword_PeepOff (void) {
+    Optimize = 0;
+}
+static void iword_SaveProfile (void) {  // ( <filename> -- )
+    FollowingToken(name, 80);
+    SaveProfile(name);                  // compile.c
+}
+static void iword_LoadProfile (void) {  // ( <filename> -- )
+    FollowingToken(name, 80);
+    LoadProfile(name);                  // compile.c
+}
+static void iword_AutoInline (void) {   // ( threshold budget -- )
+    uint32_t budget = PopNum();         // budget is in bytes of ROM
+    AutoInlineOn(PopNum(), budget);
+}
 static void iword_RunBrk (void) {       // Set breakpoint
     iword_TICK();
     breakpoint = PopNum();
@@ -735,6 +855,176 @@ static void iword_NoDbg (void) {        // run to breakpoint
     iword_CPUoff();
 }
 
+#ifdef TRACEABLE
+static void iword_Sampling (void) {     // ( cycles -- ) 0 = off
+    VMsampling(PopNum());
+}
+static void iword_ListSamples (void) {  // ( n -- ) top n words, 0 = all
+    ListSamples(PopNum());
+}
+static void iword_Timeline (void) {     // ( <filename> -- )
+    FollowingToken(name, 80);
+    tiffIOR = TimelineOpen(name);       // timeline.c
+}
+static void iword_ListLines (void) {    // ( n -- ) top n lines, 0 = all
+    ListLines(PopNum());
+}
+static void iword_MemStatsOn (void) {   // track stack extents and RAM use
+    MemStatsOn(1);
+}
+static void iword_MemStatsOff (void) {
+    MemStatsOn(0);
+}
+static void iword_NgramsOn (void) {     // start counting opcode n-grams
+    NgramsOn(1);
+}
+static void iword_NgramsOff (void) {
+    NgramsOn(0);
+}
+static void iword_ListNgrams (void) {   // ( n -- ) top n, 0 = all
+    ListNgrams(PopNum());
+}
+static void iword_SaveNgrams (void) {   // ( <filename> -- )
+    FollowingToken(name, 80);
+    SaveNgrams(name);                   // compile.c
+}
+static void Watch(int type) {           // ( addr len -- )
+    uint32_t length = PopNum();
+    tiffIOR = SetWatch(PopNum(), length, type);
+    if (!tiffIOR) iword_CPUon();
+}
+static void iword_WatchR (void) {       // break on read
+    Watch(1);
+}
+static void iword_WatchW (void) {       // break on write
+    Watch(2);
+}
+static void iword_NoWatch (void) {      // clear data breakpoints
+    ClearBreaks();
+}
+static void BreakIf(int cond) {         // ( value reg -- )
+    int reg = PopNum();
+    if (AddBreakCond(PopNum(), reg, cond)) tiffIOR = -24;
+    iword_CPUon();
+}
+static void iword_BrkEQ (void) {
+    BreakIf(0);
+}
+static void iword_BrkNE (void) {
+    BreakIf(1);
+}
+static void iword_BrkULT (void) {
+    BreakIf(2);
+}
+static void iword_BrkUGT (void) {
+    BreakIf(3);
+}
+#endif // TRACEABLE
+
+#ifdef TRACEABLE
+static void iword_SPIclock (void) {     // ( MHz lanes -- )
+    SPIlanes = PopNum();
+    SPIclockMHz = PopNum();
+    if ((SPIlanes != 1) && (SPIlanes != 2) && (SPIlanes != 4)) SPIlanes = 1;
+    if (!SPIclockMHz) SPIclockMHz = 1;
+}
+static void iword_Timeslice (void) {    // ( cycles -- ) 0 turns it off
+    VMtimeslice(PopNum());
+}
+
+// Tasks are listed by UP since the last TASKS. Slices and waits are in cycles.
+static void iword_TASKS (void) {
+    uint64_t total = 0;
+    TaskUpdate();
+    for (int i=0; i<TaskCount; i++) total += Tasks[i].cycles;
+    if (SliceCycles) {
+        printf("\nTime-slice interrupts: %u every %u cycles, up to %u cycles late",
+               SliceCount, SliceCycles, maxSliceLatency);
+    }
+    printf("\nTask     Util%%   Slices Switches MaxSlice p99Slice  MaxWait");
+    for (int i=0; i<TaskCount; i++) {
+        struct vmTask *t = &Tasks[i];
+        printf("\n%08X %5.1f %8u %8u %8u %8u %8u",
+               (t->up - RAMsize) * 4, total ? 100.0 * t->cycles / total : 0.0,
+               t->slices, t->switches, t->maxSlice, SlicePercentile(t, 99),
+               t->maxWait);
+    }
+    printf("\n%u cycles ", (uint32_t)total);
+    TaskStatsClear();
+}
+
+// Interrupt lines that are enabled or were used since the last IRQS.
+// Latency is in cycles from the raise to the ISR's first group.
+static void iword_IRQS (void) {
+    printf("\nLine Vector   Taken  Merged AvgLatency MaxLatency");
+    for (int i=0; i<IRQlines; i++) {
+        struct vmIRQ *q = &IRQstats[i];
+        uint32_t bit = 1u << i;
+        if (!(q->taken || q->merged || ((IRQenable | IRQpending) & bit))) continue;
+        printf("\n%4d %6X %7u %7u %10.1f %10u%s%s%s", i, (IRQbase + i) * 4,
+               q->taken, q->merged, q->taken ? (double)q->latency / q->taken : 0.0,
+               q->maxLatency, (IRQenable & bit) ? "" : " masked",
+               (IRQpending & bit) ? " pending" : "",
+               (IRQinService & bit) ? " in service" : "");
+    }
+    memset(IRQstats, 0, sizeof(IRQstats));
+}
+
+// Stack extents per task and the RAM the VM has touched since POR, for sizing
+// StackSpace and RAMsize. The terminal's stacks are in the StackSpace region:
+// the data stack grows down from TiffSP0 and the return stack from TiffRP0.
+static void StackRow(char *id, uint32_t *ext) {
+    if (ext[0] > ext[1]) {
+        printf("%s %8s %8s %5s", id, "-", "-", "-");
+    } else {
+        printf("%s %08X %08X %5u", id, (ext[0] - RAMsize) * 4,
+               (ext[1] - RAMsize) * 4, ext[1] - ext[0] + 1);
+    }
+}
+static void TaskStacks(char *id, struct vmTask *t, int *ds, int *rs) {
+    int sp0 = StackSpace/2, rp0 = StackSpace - 4;
+    printf("\n");
+    StackRow(id, t->sp);
+    StackRow("", t->rp);
+    if ((t->sp[0] <= t->sp[1]) && (t->sp[0] < (uint32_t)sp0)) {
+        if (*ds < (sp0 - (int)t->sp[0])) *ds = sp0 - t->sp[0];
+    }
+    if ((t->rp[0] <= t->rp[1]) && (t->rp[0] < (uint32_t)rp0)) {
+        if (*rs < (rp0 - (int)t->rp[0])) *rs = rp0 - t->rp[0];
+    }
+}
+static void iword_MEMSTATS (void) {
+    char id[10];
+    int ds = 0, rs = 0;
+    if (!MemStats) {
+        printf("\nMemory stats are off, use +memstats");
+        return;
+    }
+    printf("\nTask       SP low  SP high Cells   RP low  RP high Cells");
+    TaskStacks("(none)  ", &Untracked, &ds, &rs);
+    for (int i=0; i<TaskCount; i++) {
+        sprintf(id, "%08X", (Tasks[i].up - RAMsize) * 4);
+        TaskStacks(id, &Tasks[i], &ds, &rs);
+    }
+    int need = 2 * ((ds > rs + 4) ? ds : rs + 4);
+    printf("\nStackSpace: data stack %d, return stack %d cells deep, "
+           "needs %d cells, have %d", ds, rs, need, StackSpace);
+    if (rs > StackSpace/2 - 4) printf("\nThe return stack overflowed into the data stack");
+    if (ds >= StackSpace/2) printf("\nThe data stack overflowed");
+    uint32_t touched = 0, top = 0;
+    for (uint32_t i=0; i<RAMsize; i++) {
+        if (Touched[i >> 5] & (1u << (i & 31))) {
+            touched++;
+            top = i;
+        }
+    }
+    uint32_t size = 1;
+    while (size <= top) size <<= 1;     // RAMsize is a power of 2
+    printf("\nRAM: %u cells touched, highest at %08X, RAMsize needs %X bytes, "
+           "have %X", touched, (top - RAMsize) * 4, size * 4, RAMsize * 4);
+}
+#endif // TRACEABLE
+
 static void iword_STATS (void) {
 #ifdef TRACEABLE
     static uint32_t mark;
@@ -743,6 +1033,13 @@ static void iword_STATS (void) {
     mark = cyclecount;
     printf("\nMaximum cycles between PAUSEs: %u ", maxRPtime);
     maxRPtime = 0;
+    printf("\nSPI flash reads since last: %u random, %u sequential, %.1f us at %u MHz x%d ",
+           FlashReads[0], FlashReads[1], (double)FlashClocks / SPIclockMHz,
+           SPIclockMHz, SPIlanes);
+    FlashReads[0] = FlashReads[1] = 0;
+    FlashClocks = 0;
+    printf("\nAXI bursts since last: %u, %u cells ", AXIbursts, AXIcells);
+    AXIbursts = AXIcells = 0;
 #endif
     uint32_t cp = FetchCell(CP);
     uint32_t dp = FetchCell(DP);
@@ -838,11 +1135,47 @@ static void LoadKeywords(void) {        // populate the list of gator brain func
     AddKeyword("safe",          iword_SAFE);
     AddKeyword(".opcodes",      ListOpcodeCounts);
     AddKeyword(".profile",      ListProfile);
+    AddKeyword("+packing",      iword_PackOn);
+    AddKeyword("-packing",      iword_PackOff);
+    AddKeyword("+peephole",     iword_PeepOn);
+    AddKeyword("-peephole",     iword_PeepOff);
+    AddKeyword("save-profile",  iword_SaveProfile); // hits by word name
+    AddKeyword("load-profile",  iword_LoadProfile);
+    AddKeyword("auto-inline",   iword_AutoInline);  // ( threshold budget -- )
+    AddKeyword("-inline",       AutoInlineOff);
+    AddKeyword(".inline",       ListInlined);   // inlining size/speed tradeoff
     AddKeyword("+cpu",          iword_CPUon);
     AddKeyword("-cpu",          iword_CPUoff);
     AddKeyword("cpu",           iword_CPUgo);
     AddKeyword("dbg",           iword_RunBrk);  // set and run to breakpoint(s)
     AddKeyword("-dbg",          iword_NoDbg);
+#ifdef TRACEABLE
+    AddKeyword("watch@",        iword_WatchR);  // break on read ( addr len -- )
+    AddKeyword("watch!",        iword_WatchW);  // break on write ( addr len -- )
+    AddKeyword("-watch",        iword_NoWatch); // clear data breakpoints
+    AddKeyword("brk=",          iword_BrkEQ);   // break if reg = value ( value reg -- )
+    AddKeyword("brk<>",         iword_BrkNE);
+    AddKeyword("brku<",         iword_BrkULT);
+    AddKeyword("brku>",         iword_BrkUGT);
+    AddKeyword("spi-clock",     iword_SPIclock);    // ( MHz lanes -- ) flash model
+    AddKeyword("timeslice",     iword_Timeslice);   // ( cycles -- ) preemption
+    AddKeyword("tasks",         iword_TASKS);       // per-task CPU use
+    AddKeyword("irqs",          iword_IRQS);        // interrupt latencies
+    AddKeyword("memstats",      iword_MEMSTATS);    // stack and RAM use
+    AddKeyword("+memstats",     iword_MemStatsOn);  // track them
+    AddKeyword("-memstats",     iword_MemStatsOff);
+    AddKeyword(".xops",         ListXops);          // experimental opcodes
+    AddKeyword("sampling",      iword_Sampling);    // ( cycles -- ) profiler
+    AddKeyword(".samples",      iword_ListSamples); // ( n -- ) by word
+    AddKeyword(".lines",        iword_ListLines);   // ( n -- ) by source line
+    AddKeyword("heat",          iword_HEAT);        // locate, cycles per line
+    AddKeyword("timeline",      iword_Timeline);    // Chrome trace JSON
+    AddKeyword("-timeline",     TimelineClose);
+    AddKeyword("+ngrams",       iword_NgramsOn);    // count opcode sequences
+    AddKeyword("-ngrams",       iword_NgramsOff);
+    AddKeyword(".ngrams",       iword_ListNgrams);  // ( n -- ) the top n
+    AddKeyword("save-ngrams",   iword_SaveNgrams);  // .json or csv
+#endif // TRACEABLE
     AddKeyword("cls",           iword_CLS);
     AddKeyword("CaseSensitive", iword_CaseSensitive);
     AddKeyword("CaseInsensitive", iword_CaseIns);
@@ -907,7 +1240,18 @@ static void LoadKeywords(void) {        // populate the list of gator brain func
     AddKeyword("replace-xt",    ReplaceXTs);    // Replace XTs  ( NewXT OldXT -- )
     AddKeyword("xte-is",        xte_is);        // Replace a word's xte  ( NewXT -- )
     AddKeyword("make",          iword_MAKE);
+    AddKeyword("vectors",       iword_Vectors); // binary test vectors
+#ifdef TRACEABLE
+    AddKeyword("cosim",         iword_CoSim);   // lock-step against another VM
+#endif // TRACEABLE
+    AddKeyword("periph",        iword_Periph);      // stand-in peripheral
+    AddKeyword("load-periph",   iword_LoadPeriph);  // peripheral plugin
+    AddKeyword(".periph",       ListPeripherals);   // vmIO bus map
+    AddKeyword("xop",           iword_Xop);         // experimental opcode
     AddKeyword("save-hex",      iword_SaveHexImage);
+    AddKeyword("+shake",        iword_ShakeOn);     // drop unreachable code
+    AddKeyword("-shake",        iword_ShakeOff);
+    AddKeyword("shake-root",    iword_ShakeRoot);   // ( xt -- ) keep it
 
     AddKeyword("iwords",        ListKeywords);  // internal words, after the dictionary
 
@@ -1009,6 +1353,7 @@ static void LoadKeywords(void) {        // populate the list of gator brain func
     AddEquate ("iracc",      IRACC);
     AddEquate ("context",    CONTEXT);
     AddEquate ("forth-wordlist", FORTHWID);
+    AddEquate ("hash-threads",   HashThreads);
     AddEquate ("tib",        TIB);
     AddEquate ("|tib|",      MaxTIBsize);
     AddEquate ("head",       HEAD);
@@ -1109,6 +1454,7 @@ ex: PopNum();                           // keyword is an empty string
 static int Refill(void) {
     int TIBaddr = FetchCell(TIBB);
     StoreCell(0, TOIN);
+    SourceLine(File.FID, File.LineNumber);  // code from the previous line
     int length = GetLine(File.Line, MaxTIBsize, File.fp);
     if (length < 0) {                   // EOF, un-nest
 #ifdef VERBOSE
@@ -1186,6 +1532,7 @@ void tiffQUIT (char *cmdline) {
 #ifdef __linux__
                         CookedMode();
 #endif // __linux__
+                        SourceLine(0, 0);       // typed code has no source
                         length = GetLine(File.Line, MaxTIBsize, stdin);   // get input line
                         File.Line[length] = 0;
                     }
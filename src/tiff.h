@@ -26,6 +26,7 @@ void tiffQUIT (char *cmdline);
 void iword_COLD(void);
 extern char *DefaultFile;
 extern int HeadPointerOrigin;
+char *LocateFilename (int id);
 
 // reference to TiffUser function when Linux is used for I/O
 void CookedMode(void);
@@ -83,9 +84,10 @@ void UnCase(char *s);
 #define PADsize     64
 #define PAD         (TIB + MaxTIBsize)
 #define FORTHWID    (PAD + PADsize)       /* Forth wordlist                   */
-#define DataPointerOrigin (FORTHWID + 4)  /* Data starts after TIB            */
+#define DataPointerOrigin (FORTHWID + 4 + 4*HashThreads)  /* Data after WID */
 
 // The first free cell in data space is right after the main wordlist WID.
+// With hashed threads, the WID is followed by the head of each thread.
 // If your app uses more wordlists, you might put their WIDs here so as to keep
 // all WIDs grouped together. This would support MARKER.
 
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "config.h"
+#include "vm.h"
+#include "accessvm.h"
+#include "compile.h"
+#include "timeline.h"
+
+// Timeline export: word entry and exit spans from call and exit, task
+// switches, user functions and SPI flash erase and program commands.
+// Each task is a thread in the viewer, so its spans nest on their own track
+// and the interleaving of tasks shows directly. A span ends when the return
+// address pushed by its call leaves the return stack, so EXIT after >R and
+// unwinding by RP! keep the spans balanced. An EXIT to the start of a word is
+// a jump through the return stack, as in EXECUTE, so it starts a span for
+// that word that ends with its caller's. Events go into a large
+// buffer that is written in big blocks. Since the timestamps are cycle
+// counts, the time spent writing doesn't show up in the timeline.
+// Call targets are named from the headers once and then cached. A target
+// that isn't the start of a known word reloads the headers once, in case it
+// was defined since they were last loaded.
+
+#ifdef TRACEABLE
+
+#define TimelineBufSize  0x40000
+#define NameCacheSize    0x4000         // call targets, a power of 2
+#define MaxSpans         256            // open spans per task
+
+int Timeline;
+static FILE *TLfile;
+static char *TLbuf;
+static int TLlen;
+static struct Owner *Words;             // words by code address
+static int WordCount;
+static struct NameCache {
+    uint32_t cell;                      // call target + 1, 0 = empty
+    char name[32];
+} *Names;
+static int NamesCached;
+static uint32_t TaskIDs[64];            // UP of each tid
+static int TidCount, Tid;
+static uint32_t Marks[65][MaxSpans];    // RP of each open span, by tid
+static int Depth[65];
+
+static void TLflush(void) {
+    fwrite(TLbuf, 1, TLlen, TLfile);
+    TLlen = 0;
+}
+
+static void TLput(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    TLlen += vsnprintf(&TLbuf[TLlen], TimelineBufSize - TLlen, format, args);
+    va_end(args);
+    if (TLlen > (TimelineBufSize - 256)) TLflush();
+}
+
+static int TaskID(uint32_t up) {        // tid of a task, new ones are named
+    for (int i=0; i<TidCount; i++) {
+        if (TaskIDs[i] == up) return i + 1;
+    }
+    if (TidCount == 64) return 0;      // too many, share tid 0
+    TaskIDs[TidCount++] = up;
+    TLput(",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,"
+          "\"args\":{\"name\":\"task %08X\"}}", TidCount, (up - RAMsize) * 4);
+    return TidCount;
+}
+
+static int FindWord(uint32_t cell) {    // index of the word starting at cell
+    struct Owner *w = OwnerOf(Words, WordCount, cell);
+    return (w && (w->start == cell)) ? (int)(w - Words) : -1;
+}
+
+static char * WordName(uint32_t cell) {
+    uint32_t h = (cell * 2654435761u) >> 18;
+    while (Names[h].cell && (Names[h].cell != cell + 1)) {
+        h = (h + 1) & (NameCacheSize - 1);
+    }
+    if (Names[h].cell) return Names[h].name;
+    if (NamesCached == NameCacheSize/2) {   // keep the probes short
+        memset(Names, 0, NameCacheSize * sizeof(struct NameCache));
+        NamesCached = 0;
+    }
+    int i = FindWord(cell);
+    if (i < 0) {                        // defined since the headers were read?
+        free(Words);
+        Words = Owners(&WordCount);     // compile.c
+        i = FindWord(cell);
+    }
+    char *s = Names[h].name;
+    if (i < 0) {
+        sprintf(s, "%X", cell * 4);
+    } else {
+        FetchString(s, Words[i].ht + 5, FetchByte(Words[i].ht + 4) & 0x1F);
+        for (; *s; s++) {
+            if ((*s == '"') || (*s == '\\')) *s = '?';  // keep the JSON valid
+        }
+    }
+    Names[h].cell = cell + 1;
+    NamesCached++;
+    return Names[h].name;
+}
+
+static void Unwind(uint32_t rp) {       // end spans whose return was popped
+    while (Depth[Tid] && (Marks[Tid][Depth[Tid] - 1] < rp)) {
+        TLput(",\n{\"ph\":\"E\",\"ts\":%u,\"pid\":1,\"tid\":%d}", cyclecount, Tid);
+        Depth[Tid]--;
+    }
+}
+
+static void Span(char *name, uint32_t rp) {     // rp holds the return address
+    if (Depth[Tid] == MaxSpans) return; // too deep, not shown
+    Marks[Tid][Depth[Tid]++] = rp;
+    TLput(",\n{\"ph\":\"B\",\"ts\":%u,\"pid\":1,\"tid\":%d,\"name\":\"%s\"}",
+          cyclecount, Tid, name);
+}
+
+void TimelineEvent(int type, uint32_t a, uint32_t b) {  /*EXPORT*/
+    char name[16];
+    switch (type) {
+    case TimelineCall:
+        Unwind(b + 1);                  // RP before the call
+        Span(WordName(a), b);
+        break;
+    case TimelineExit:
+        Unwind(b);
+        if (FindWord(a) >= 0) {         // jump, not a return
+            Span(WordName(a), b);
+        }
+        break;
+    case TimelineRP:
+        Unwind(a);
+        break;
+    case TimelineTask:
+        Tid = TaskID(a);
+        TLput(",\n{\"ph\":\"i\",\"ts\":%u,\"pid\":1,\"tid\":%d,\"s\":\"t\","
+              "\"name\":\"up!\"}", cyclecount, Tid);
+        break;
+    case TimelineUser:
+        TLput(",\n{\"ph\":\"i\",\"ts\":%u,\"pid\":1,\"tid\":%d,\"s\":\"t\","
+              "\"name\":\"user %u\",\"args\":{\"T\":%u}}", cyclecount, Tid, a, b);
+        break;
+    case TimelineIRQ:
+        Unwind(b + 1);
+        sprintf(name, "IRQ %u", a);
+        Span(name, b);
+        break;
+    case TimelineFlash:
+        TLput(",\n{\"ph\":\"i\",\"ts\":%u,\"pid\":1,\"tid\":%d,\"s\":\"g\","
+              "\"name\":\"flash %s\",\"args\":{\"spi\":\"%X\"}}", cyclecount,
+              Tid, (b == 0x20) ? "erase" : "program", a);
+        break;
+    }
+}
+
+void TimelineClose(void) {  /*EXPORT*/
+    if (!Timeline) return;
+    TLput("\n]}\n");
+    TLflush();
+    fclose(TLfile);
+    free(TLbuf);  free(Words);  free(Names);
+    Timeline = 0;
+}
+
+int TimelineOpen(char *filename) {  /*EXPORT*/
+    static int registered;
+    TimelineClose();
+    TLfile = fopen(filename, "w");
+    if (TLfile == NULL) return -199;    // can't open file
+    if (!registered) atexit(TimelineClose);
+    registered = 1;
+    TLbuf = malloc(TimelineBufSize);
+    TLlen = 0;
+    Words = Owners(&WordCount);
+    Names = calloc(NameCacheSize, sizeof(struct NameCache));
+    NamesCached = 0;
+    TidCount = 0;
+    memset(Depth, 0, sizeof(Depth));
+    TLput("{\"otherData\":{\"clock\":\"VM cycles\"},\"traceEvents\":[\n"
+          "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,"
+          "\"args\":{\"name\":\"Mforth VM\"}}");
+    Tid = TaskID((vmRegRead(4) >> 2) & (RAMsize-1));
+    Timeline = 1;
+    return 0;
+}
+
+#else
+
+int Timeline;
+int TimelineOpen(char *filename) { return -21; }
+void TimelineClose(void) {}
+void TimelineEvent(int type, uint32_t a, uint32_t b) {}
+
+#endif // TRACEABLE
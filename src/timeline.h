@@ -0,0 +1,26 @@
+//===============================================================================
+// timeline.h
+//===============================================================================
+#ifndef __TIMELINE_H__
+#define __TIMELINE_H__
+#include <stdint.h>
+
+// Execution timeline in Chrome trace-event JSON, for chrome://tracing or
+// ui.perfetto.dev. Timestamps are cyclecount: one microsecond in the viewer
+// is one VM clock cycle.
+
+#define TimelineCall    0               // a = cell address called, b = RP
+#define TimelineExit    1               // a = cell address returned to, b = RP
+#define TimelineTask    2               // a = UP, cell index
+#define TimelineUser    3               // a = function, b = T
+#define TimelineIRQ     4               // a = line, b = RP
+#define TimelineFlash   5               // a = SPI address, b = SPI command
+#define TimelineRP      6               // a = RP
+
+extern int Timeline;                    // events are being written
+
+int TimelineOpen(char *filename);       // start writing, 0 or ior
+void TimelineClose(void);               // finish the file
+void TimelineEvent(int type, uint32_t a, uint32_t b);
+
+#endif // __TIMELINE_H__
@@ -5,6 +5,10 @@
 #include "vmUser.h"
 #include "vmHost.h"
 #include "flash.h"
+#ifdef TRACEABLE
+#include "xop.h"
+#include "timeline.h"
+#endif // TRACEABLE
 #include <string.h>
 
 // This file serves as the official specification for the Mforth VM.
@@ -28,17 +32,20 @@
 
 /* -----------------------------------------------------------------------------
     Globals:
-        tiffIOR
+        tiffIOR, ROMchanged
         If TRACEABLE: VMreg[], OpCounter[], ProfileCounts[], cyclecount, maxRPtime, maxReturnPC
+                      SliceCycles, SliceCount, maxSliceLatency, Tasks[], TaskCount,
+                      IRQpending, IRQenable, IRQinService, IRQbase, IRQlatency, IRQstats[]
     Exports:
-        VMpor, VMstep, vmMEMinit, SetDbgReg, GetDbgReg, vmRegRead,
+        VMpor, VMstep, vmMEMinit, SetDbgReg, GetDbgReg, vmRegRead, VMinterrupts,
         FetchCell, FetchHalf, FetchByte, StoreCell, StoreHalf, StoreByte,
-        In not embedded: WriteROM
+        In not embedded: WriteROM, ProgramROM
 
     Addresses are VM byte addresses
 */
 
 /*global*/ int tiffIOR;                 // error code for the C-based QUIT loop
+/*global*/ int ROMchanged = 1;          // ROM or flash written since last read
 #ifndef EmbeddedROM
 /*global*/ uint32_t RAMsize = RAMsizeDefault;
 /*global*/ uint32_t ROMsize = ROMsizeDefault;
@@ -48,6 +55,7 @@ char * LoadFlashFilename = NULL;
 #endif
 
 static int exception = 0;               // local error code
+static int IntEnable = 0;               // interrupts are enabled
 
 //`0`static const uint32_t InternalROM[`2`] = {`10`};
 //`0`uint32_t FetchROM(uint32_t addr) {
@@ -94,16 +102,115 @@ static int exception = 0;               // local error code
     uint32_t VMreg[VMregs];     // registers with undo capability
     uint32_t OpCounter[64];     // opcode counter
     uint32_t * ProfileCounts;
+    uint32_t * ProfileCycles;   // cycles spent in each ROM group
     uint32_t cyclecount;
     uint32_t maxRPtime;   		// max cycles between RETs
     uint32_t maxReturnPC = 0;   // PC where it occurred
     static uint32_t RPmark;
 
+    // Time-slice interrupt and cycle accounting per task, keyed by UP.
+    uint32_t SliceCycles;       // cycles between time-slice interrupts, 0=off
+    uint32_t SliceCount;        // time-slice interrupts taken
+    uint32_t maxSliceLatency;   // max cycles an interrupt was held off
+    static uint32_t SliceDue;   // cyclecount when the next one is due
+    struct vmTask Tasks[MaxTasks];
+    int TaskCount;
+    static struct vmTask * Running;
+    static uint32_t SliceStart; // cyclecount when Running got the CPU
+    static uint32_t ChargeMark; // cycles are charged to Running up to here
+
+    // Interrupt controller: line 0 has the highest priority and is the time
+    // slice. Line n vectors to cell IRQbase+n.
+    uint32_t IRQpending;        // raised but not taken yet
+    uint32_t IRQenable;         // mask, 1 = enabled
+    uint32_t IRQinService;      // taken, waiting for end of interrupt
+    uint32_t IRQbase;           // vector table, cell address
+    uint32_t IRQlatency;        // cycles from raise to entry, last interrupt
+    struct vmIRQ IRQstats[IRQlines];
+    static uint32_t IRQraised[IRQlines];    // cyclecount when raised
+
+    // Opcode n-grams, counted while Bigrams is allocated. Index 0 of each
+    // table counts sequences within one group, 1 those that span groups.
+    uint32_t * Bigrams;         // [2][64*64], NULL = not counting
+    uint32_t * Trigrams;        // [2][64*64*64]
+    uint32_t SlotOps[6][64];    // opcodes executed in each slot position
+    uint32_t GroupEnds[6][64];  // last opcode executed in a group, by slot
+    static unsigned int Recent; // last two opcodes, 6 bits each
+    static unsigned int Seams;  // bit n: group boundary before opcode n back
+    static int RecentCount;     // opcodes in Recent
+    static int Seam;            // next opcode starts a group
+
+    // Sampling profiler: every SamplePeriod cycles the PC of the next group
+    // and the top of the return stack go into Samples, and the per-group and
+    // per-opcode counters are off. When the buffer fills, every other sample
+    // is dropped and the period doubles, so a long run still fits.
+    uint32_t SampleCycles;      // requested period, 0 = off
+    uint32_t SamplePeriod;      // current period
+    uint32_t * Samples;         // pairs of PC (cell) and return address (byte)
+    uint32_t SampleCount;       // pairs in Samples
+    static uint32_t SampleDue;  // cyclecount when the next one is due
+    static int Counting = 1;    // OpCounter and ProfileCounts are on
+
+    // Watchpoints: one bit per RAM cell for reads and for writes.
+    // They are only armed while VMstep runs code, not for debugger access.
+    static uint32_t WatchBits[2][MaxRAMsize/32];
+    static int Watches;         // some WatchBits are set
+    static int Watching;        // VMstep checks RAM accesses: watches or memstats
+    uint32_t WatchAddr;         // byte address of the last watchpoint hit
+    int WatchType;              // 0 = none, 1 = read, 2 = write
+    #define WATCHED(rw, ra)  (WatchBits[rw][(ra) >> 5] & (1u << ((ra) & 31)))
+
+    static void WatchHit(int type, uint32_t ra) {
+        WatchType = type;
+        WatchAddr = (ra - RAMsize) * 4;
+    }
+
+    // Memory use: the RAM cells the VM touched, and the stack extents of the
+    // task charged for the stacks. After a task switch, a stack is charged
+    // from the first SP! or RP!, until then it's still the old task's stack.
+    // The bookkeeping costs time in the hot paths, so it is off until +memstats.
+    int MemStats;               // tracking is on
+    uint32_t Touched[MaxRAMsize/32];
+    struct vmTask Untracked;
+    static struct vmTask * Stacks = &Untracked;
+    static int StackKnown;      // bit 0 = SP, bit 1 = RP
+    #define STACKS(bit)  (MemStats && Watching && (StackKnown & (bit)))
+
+    static void Access(int rw, uint32_t ra) {   // VM access to a RAM cell
+        if (MemStats) Touched[ra >> 5] |= 1u << (ra & 31);
+        if (WATCHED(rw, ra)) WatchHit(rw + 1, ra);
+    }
+    static void Extent(uint32_t *ext, uint32_t p) { // widen a stack extent
+        p &= RAMsize-1;
+        if (p < ext[0]) ext[0] = p;
+        if (p > ext[1]) ext[1] = p;
+    }
+    static void NoExtent(struct vmTask *t) {
+        t->sp[0] = t->rp[0] = ~0;
+        t->sp[1] = t->rp[1] = 0;
+    }
+    void MemStatsClear(void) {  // EXPORTED
+        memset(Touched, 0, sizeof(Touched));
+        NoExtent(&Untracked);
+        for (int i=0; i<TaskCount; i++) NoExtent(&Tasks[i]);
+    }
+    void MemStatsOn(int on) {  // EXPORTED
+        if (on && !MemStats) MemStatsClear();
+        MemStats = on;
+    }
+
     static int New; // New trace type, used to mark new sections of trace
 
+    // Only the debugger's single steps record a trace. A free run, sampled or
+    // not, skips the call for each state change.
+    #define Trace(type, id, old, new)  do { \
+        if (Tracing) (Trace)(type, id, old, new); } while (0)
+
     static void SDUP(void)  {
         Trace(New,RidSP,SP,SP-1); New=0;
                      --SP;
+        if (Watching) Access(1, SP & (RAMsize-1));
+        if (STACKS(1)) Extent(Stacks->sp, SP);
         Trace(0,SP & (RAMsize-1),RAM[SP & (RAMsize-1)],  N);
                                  RAM[SP & (RAMsize-1)] = N;
         Trace(0, RidN, N,  T);
@@ -114,21 +221,230 @@ static int exception = 0;               // local error code
         Trace(0, RidN, N,  RAM[SP & (RAMsize-1)]);
                        N = RAM[SP & (RAMsize-1)];
         Trace(0,RidSP,SP,SP+1);
-                   SP++; }
+                   SP++;
+        if (STACKS(1)) Extent(Stacks->sp, SP); }
     static void SNIP(void)  {
         Trace(New,RidN,N,  RAM[SP & (RAMsize-1)]);  New=0;
                        N = RAM[SP & (RAMsize-1)];
         Trace(0,RidSP, SP,SP+1);
-                       SP++; }
+                       SP++;
+        if (STACKS(1)) Extent(Stacks->sp, SP); }
     static void RDUP(uint32_t x)  {
         Trace(New,RidRP,RP,RP-1); New=0;
                        --RP;
+        if (Watching) Access(1, RP & (RAMsize-1));
+        if (STACKS(2)) Extent(Stacks->rp, RP);
         Trace(0,RP & (RAMsize-1),RAM[RP & (RAMsize-1)],  x);
                                  RAM[RP & (RAMsize-1)] = x; }
     static uint32_t RDROP(void) {
         uint32_t r = RAM[RP & (RAMsize-1)];
         Trace(New,RidRP, RP,RP+1);  New=0;
-                         RP++;  return r; }
+                         RP++;
+        if (STACKS(2)) Extent(Stacks->rp, RP);
+        return r; }
+
+    void TaskUpdate(void) {  // EXPORTED
+        if (Running) Running->cycles += cyclecount - ChargeMark;
+        ChargeMark = cyclecount;
+    }
+    void TaskStatsClear(void) {  // EXPORTED
+        TaskUpdate();
+        for (int i=0; i<TaskCount; i++) {
+            struct vmTask keep = Tasks[i];  // ID and stack extents
+            memset(&Tasks[i], 0, sizeof(struct vmTask));
+            Tasks[i].up = keep.up;
+            memcpy(Tasks[i].sp, keep.sp, sizeof(keep.sp));
+            memcpy(Tasks[i].rp, keep.rp, sizeof(keep.rp));
+            Tasks[i].stopped = cyclecount;
+        }
+        SliceStart = cyclecount;
+        SliceCount = maxSliceLatency = 0;
+    }
+
+    // Slice length bins: 0 to 3 are exact, then 4 bins per power of 2.
+    static int SliceBin(uint32_t x) {
+        int e = 2;
+        if (x < 4) return x;
+        while (x >> (e+1)) e++;         // e = log2(x)
+        return 4*(e-1) + ((x >> (e-2)) & 3);
+    }
+    static uint32_t SliceBinTop(int bin) {
+        if (bin < 4) return bin;
+        int e = bin/4 + 1;
+        return ((5u + (bin & 3)) << (e-2)) - 1;
+    }
+    // Upper bound of the bin holding the given percentile of finished slices
+    uint32_t SlicePercentile(struct vmTask *t, int percent) {  // EXPORTED
+        uint64_t need, sum = 0;
+        for (int i=0; i<SliceBins; i++) sum += t->hist[i];
+        need = (sum * percent + 99) / 100;
+        sum = 0;
+        for (int i=0; i<SliceBins; i++) {
+            sum += t->hist[i];
+            if (sum && (sum >= need)) {
+                uint32_t top = SliceBinTop(i);
+                return (top < t->maxSlice) ? top : t->maxSlice;
+            }
+        }
+        return 0;
+    }
+
+    // UP! switches tasks: the old task's slice ends and the new one's begins.
+    static void TaskSwitch(uint32_t up) {
+        struct vmTask *t = Tasks;
+        struct vmTask *old = Running;
+        int i = 0;
+        TaskUpdate();
+        if (old) {
+            uint32_t length = cyclecount - SliceStart;
+            old->hist[SliceBin(length)]++;
+            if (length > old->maxSlice) old->maxSlice = length;
+            old->stopped = cyclecount;
+        }
+        while ((i < TaskCount) && (t->up != up)) {
+            i++;  t++;
+        }
+        Running = NULL;
+        Stacks = &Untracked;
+        StackKnown = 0;
+        SliceStart = cyclecount;
+        if (i == TaskCount) {
+            if (TaskCount == MaxTasks) return;  // too many to track
+            memset(t, 0, sizeof(struct vmTask));
+            NoExtent(t);
+            t->up = up;
+            t->stopped = cyclecount;
+            TaskCount++;
+        }
+        if (old && (old != t)) old->switches++;
+        uint32_t wait = cyclecount - t->stopped;
+        if (wait > t->maxWait) t->maxWait = wait;
+        t->slices++;
+        Running = Stacks = t;
+    }
+
+    // Raise an interrupt line. A peripheral that finds out about an event
+    // after the group it happened in passes the cycles since the event.
+    int VMirq(int line, uint32_t ago) {  // EXPORTED
+        if ((unsigned)line >= IRQlines) return -24;  // invalid numeric argument
+        uint32_t bit = 1u << line;
+        if (IRQpending & bit) {
+            IRQstats[line].merged++;    // already pending, counts once
+            return 0;
+        }
+        IRQpending |= bit;
+        IRQraised[line] = cyclecount - ago;
+        return 0;
+    }
+    // End of interrupt: the highest priority line in service is done
+    void VMeoi(void) {  // EXPORTED
+        IRQinService &= IRQinService - 1;
+    }
+    static int Highest(uint32_t lines) {    // lines is not 0
+        int n = 0;
+        while (!(lines & 1)) {
+            lines >>= 1;  n++;
+        }
+        return n;
+    }
+
+    // Interrupts are taken between groups, like the error interrupt, unless
+    // disabled or Tiff's Execute is finishing. A line only interrupts the ISR
+    // of a lower priority line. Entry disables interrupts, so nesting starts
+    // when the ISR enables them. Line 0 is left out of IRQinService because
+    // the time slice switches tasks instead of returning.
+    static void Interrupt(void) {
+        uint32_t ready = IRQpending & IRQenable;
+        if (!ready || !IntEnable || exception || (PC == 0x37AB7037)) return;
+        int line = Highest(ready);
+        if (IRQinService && (line >= Highest(IRQinService))) return;
+        IRQlatency = cyclecount - IRQraised[line];
+        if (IRQlatency > IRQstats[line].maxLatency) {
+            IRQstats[line].maxLatency = IRQlatency;
+        }
+        IRQstats[line].taken++;
+        IRQstats[line].latency += IRQlatency;
+        if (line == 0) {
+            SliceCount++;
+            if (IRQlatency > maxSliceLatency) maxSliceLatency = IRQlatency;
+        } else {
+            IRQinService |= 1u << line;
+        }
+        IRQpending &= ~(1u << line);
+        IntEnable = 0;
+        RDUP(PC<<2);
+        if (Timeline) TimelineEvent(TimelineIRQ, line, RP & (RAMsize-1));
+        Trace(0, RidPC, PC, IRQbase + line);
+        PC = IRQbase + line;
+        cyclecount += 3;                // like a call
+    }
+    static void TimeSlice(void) {
+        if ((int32_t)(cyclecount - SliceDue) < 0) return;
+        VMirq(0, cyclecount - SliceDue);
+        SliceDue += SliceCycles;
+        if ((int32_t)(cyclecount - SliceDue) >= 0) {
+            SliceDue = cyclecount + SliceCycles;    // don't pile up
+        }
+    }
+    void VMtimeslice(uint32_t cycles) {  // EXPORTED
+        SliceCycles = cycles;
+        SliceDue = cyclecount + cycles;
+    }
+
+    void VMsampling(uint32_t cycles) {  // EXPORTED
+        free(Samples);  Samples = NULL;
+        SampleCount = 0;
+        SampleCycles = SamplePeriod = cycles;
+        SampleDue = cyclecount + cycles;
+        if (cycles) {
+            Samples = malloc(MaxSamples * 2 * sizeof(uint32_t));
+        }
+        Counting = (Samples == NULL);
+    }
+    static void Sample(void) {
+        if (SampleCount == MaxSamples) {
+            for (int i=0; i<MaxSamples/2; i++) {    // keep every other one
+                Samples[i*2]     = Samples[i*4];
+                Samples[i*2 + 1] = Samples[i*4 + 1];
+            }
+            SampleCount = MaxSamples/2;
+            SamplePeriod *= 2;
+        }
+        Samples[SampleCount*2]     = PC;
+        Samples[SampleCount*2 + 1] = RAM[RP & (RAMsize-1)];
+        SampleCount++;
+        SampleDue += SamplePeriod;
+        if ((int32_t)(cyclecount - SampleDue) >= 0) {
+            SampleDue = cyclecount + SamplePeriod;  // don't pile up
+        }
+    }
+
+    void NgramsOn(int on) {  // EXPORTED
+        free(Bigrams);  free(Trigrams);
+        Bigrams = Trigrams = NULL;
+        memset(SlotOps, 0, sizeof(SlotOps));
+        memset(GroupEnds, 0, sizeof(GroupEnds));
+        RecentCount = 0;
+        if (on) {
+            Bigrams  = calloc(2*64*64, sizeof(uint32_t));
+            Trigrams = calloc(2*64*64*64, sizeof(uint32_t));
+            if (Trigrams == NULL) NgramsOn(0);
+        }
+    }
+    static void CountNgrams(unsigned int opcode, int slot) {
+        SlotOps[(26 - slot) / 6][opcode]++;
+        if (RecentCount > 1) {          // a seam before either of the last two
+            int across = Seam | (Seams & 1);
+            Trigrams[(across << 18) + ((Recent & 07777) << 6) + opcode]++;
+        }
+        if (RecentCount > 0) {
+            Bigrams[(Seam << 12) + ((Recent & 077) << 6) + opcode]++;
+        }
+        if (RecentCount < 2) RecentCount++;
+        Recent = (Recent << 6) | opcode;
+        Seams = (Seams << 1) | Seam;
+        Seam = 0;
+    }
 
 #else
     static uint32_t T;	    static uint32_t RP = 64;
@@ -144,6 +460,9 @@ static uint32_t FetchX (int32_t addr, int shift, int32_t mask) {
     if (addr < 0) {
         int addrmask = RAMsize-1;
         cell = RAM[addr & addrmask];
+#ifdef TRACEABLE
+        if (Watching) Access(0, addr & addrmask);
+#endif // TRACEABLE
     } else if (addr >= ROMsize) {
         cell = FlashRead(addr << 2);
     } else {
@@ -164,6 +483,7 @@ static void StoreX (int32_t addr, uint32_t data, int shift, int32_t mask) {
         int ra = addr & (RAMsize - 1);
         uint32_t temp = RAM[ra] & (~(mask << shift));
 #ifdef TRACEABLE
+        if (Watching) Access(1, ra);
         temp = ((data & mask) << shift) | temp;
         Trace(New, ra, RAM[ra], temp);  New=0;
         RAM[ra] = temp;
@@ -188,6 +508,7 @@ void vmMEMinit(char * name){            // erase all ROM and flash,
   #ifdef TRACEABLE
     if (NULL == ProfileCounts) {
         ProfileCounts = (uint32_t*) malloc(MaxROMsize * sizeof(uint32_t));
+        ProfileCycles = (uint32_t*) malloc(MaxROMsize * sizeof(uint32_t));
     }
   #endif
     // initialize actual sizes
@@ -195,6 +516,7 @@ void vmMEMinit(char * name){            // erase all ROM and flash,
     memset(RAM,  0, RAMsize*sizeof(uint32_t));
 #endif // EmbeddedROM
     FlashInit(LoadFlashFilename);
+    ROMchanged = 1;
 };
 
 #ifndef EmbeddedROM
@@ -210,6 +532,9 @@ void ROMbye (void) {					// free VM memory if it used malloc
 int WriteROM(uint32_t data, uint32_t address) {
     return -20;                         // writing to read-only memory
 }
+int ProgramROM(const uint32_t *src, uint32_t address, int cells) {
+    return -20;
+}
 #else
 int WriteROM(uint32_t data, uint32_t address) {
     uint32_t addr = address >> 2;
@@ -217,6 +542,7 @@ int WriteROM(uint32_t data, uint32_t address) {
     if (addr >= (SPIflashBlocks<<10)) return -9;
     if (addr < ROMsize) {
         ROM[addr] = data;
+        ROMchanged = 1;
         return 0;
     }
     tiffIOR = FlashWrite(data, address);
@@ -225,6 +551,23 @@ int WriteROM(uint32_t data, uint32_t address) {
            tiffIOR = -20;
     return tiffIOR;
 }
+
+// Program a block of cells into internal ROM the way StoreROM does: bits can
+// only be cleared. Used by bulk loaders such as LoadHexImage.
+int ProgramROM(const uint32_t *src, uint32_t address, int cells) {
+    uint32_t addr = address >> 2;
+    if (address & 3) return -23;        // alignment problem
+    if ((addr + cells) > ROMsize) return -9;
+    int ior = 0;
+    uint32_t *dest = &ROM[addr];
+    ROMchanged = 1;
+    while (cells--) {
+        uint32_t x = *src++;
+        if (~(*dest | x)) ior = -60;    // non-blank bits
+        *dest++ &= x;
+    }
+    return ior;
+}
 #endif // EmbeddedROM
 
 uint32_t FetchCell(int32_t addr) {
@@ -233,6 +576,9 @@ uint32_t FetchCell(int32_t addr) {
     }
 	int32_t ca = addr>>2;  // if addr<0, "/4" <> ">>2". weird, huh?
     if (addr < 0) {
+#ifdef TRACEABLE
+        if (Watching) Access(0, ca & (RAMsize-1));
+#endif // TRACEABLE
         return (RAM[ca & (RAMsize-1)]);
     }
     if (ca < ROMsize) {
@@ -310,6 +656,48 @@ void StoreByte (uint8_t x, int32_t addr) {
     StoreX(addr>>2, x, shift, 0xFF);
 }
 
+// Block transfers between RAM and a buffer, used by AXI bursts in vmUser.c.
+// addr is a RAM byte address. The block may not run past the top of RAM.
+// Below that, addresses wrap as other RAM accesses do.
+// They return 0 or an ior, and move nothing if the block is invalid.
+
+static int RAMblock (int32_t addr, int cells) {    // ior
+    if (addr & 3) {
+        exception = -23;  return -23;
+    }
+    if (((addr >> 2) + cells) > 0) {
+        exception = -9;   return -9;
+    }
+    return 0;
+}
+
+int FetchBlock (uint32_t *dest, int32_t addr, int cells) {
+    int ior = RAMblock(addr, cells);
+    if (ior) return ior;
+    for (int i=0; i<cells; i++) {
+        uint32_t ra = ((addr >> 2) + i) & (RAMsize-1);
+#ifdef TRACEABLE
+        if (Watching) Access(0, ra);
+#endif // TRACEABLE
+        dest[i] = RAM[ra];
+    }
+    return 0;
+}
+
+int StoreBlock (const uint32_t *src, int32_t addr, int cells) {
+    int ior = RAMblock(addr, cells);
+    if (ior) return ior;
+    for (int i=0; i<cells; i++) {
+        uint32_t ra = ((addr >> 2) + i) & (RAMsize-1);
+#ifdef TRACEABLE
+        if (Watching) Access(1, ra);
+        Trace(New, ra, RAM[ra], src[i]);  New=0;   // undo needs the old contents
+#endif // TRACEABLE
+        RAM[ra] = src[i];
+    }
+    return 0;
+}
+
 #ifdef TRACEABLE
     // Untrace undoes a state change by restoring old data
     void UnTrace(int32_t ID, uint32_t old) {  // EXPORTED
@@ -318,12 +706,43 @@ void StoreByte (uint8_t x, int32_t addr) {
             if (idx < VMregs) {
                 VMreg[idx] = old;
             }
-        } else {
-            StoreX(ID, old, 0, 0xFFFFFFFF);
+        } else {                        // ID is a RAM cell index
+            StoreX(ID | -RAMsize, old, 0, 0xFFFFFFFF);
         }
     }
 #endif // TRACEABLE
 
+#ifdef TRACEABLE
+    // Set or clear watchpoints on a RAM byte range, return an ior.
+    // Type: bit 0 = break on read, bit 1 = break on write, 0 = clear.
+    int SetWatch(int32_t addr, uint32_t bytes, int type) {  // EXPORTED
+        if (addr >= 0) return -9;       // RAM only, invalid memory address
+        uint32_t ra = (addr >> 2) & (RAMsize-1);
+        uint32_t cells = (bytes + (addr & 3) + 3) >> 2;
+        if (cells > RAMsize) cells = RAMsize;
+        while (cells--) {
+            for (int rw=0; rw<2; rw++) {
+                if (type & (1<<rw)) {
+                    WatchBits[rw][ra >> 5] |=  (1u << (ra & 31));
+                } else {
+                    WatchBits[rw][ra >> 5] &= ~(1u << (ra & 31));
+                }
+            }
+            ra = (ra + 1) & (RAMsize-1);
+        }
+        Watches = 0;
+        for (uint32_t i=0; i<(RAMsize+31)/32; i++) {
+            if (WatchBits[0][i] | WatchBits[1][i]) Watches = 1;
+        }
+        return 0;
+    }
+    void ClearWatches(void) {  // EXPORTED
+        memset(WatchBits, 0, sizeof(WatchBits));
+        Watches = 0;
+        WatchType = 0;
+    }
+#endif // TRACEABLE
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Access to the VM is through four functions:
 ///    VMstep       // Execute an instruction group
@@ -337,10 +756,24 @@ void VMpor(void) {  // EXPORTED
 #ifdef TRACEABLE
     memset(OpCounter,0,64*sizeof(uint32_t)); // clear opcode profile counters
     memset(ProfileCounts, 0, ROMsize*sizeof(uint32_t));  // clear profile counts
+    memset(ProfileCycles, 0, ROMsize*sizeof(uint32_t));
     cyclecount = 0;                     // cycles since POR
     RPmark = 0;
     maxRPtime = 0;
+    SliceDue = SliceCycles;
+    SampleDue = SamplePeriod;
+    SliceCount = maxSliceLatency = 0;
+    TaskCount = 0;
+    Running = NULL;
+    Stacks = &Untracked;
+    StackKnown = 3;
+    MemStatsClear();
+    IRQpending = IRQinService = 0;
+    IRQenable = 1;                      // only the time slice
+    IRQbase = TimerVector;
+    memset(IRQstats, 0, sizeof(IRQstats));
 #endif // TRACEABLE
+    IntEnable = 0;
     PC = 0;  RP = 64;  SP = 32;  UP = 64;
     T=0;  N=0;  DebugReg = 0;
     memset(RAM,  0, RAMsize*sizeof(uint32_t));       // clear RAM
@@ -362,9 +795,23 @@ uint32_t VMstep(uint32_t IR, int Paused) {  // EXPORTED
 // to show up, it's latched into IR. Otherwise, there will be some delay while
 // memory returns the instruction.
 
+#ifdef TRACEABLE
+    uint32_t start = cyclecount;
+    uint32_t group = PC;
+    Watching = !Paused && Counting      // debugger groups and sampled runs
+            && (Watches || MemStats);   // don't hit watchpoints or track RAM
+    FlashTimed = !Paused;               // nor do debugger groups charge flash reads
+    if (FlashTimed && (PC >= ROMsize)) {
+        FlashRead(PC << 2);             // the caller fetched IR from flash
+    }
+    Seam = 1;
+#endif // TRACEABLE
     if (!Paused) {
 #ifdef TRACEABLE
-        if (PC < ROMsize) {
+        if (Samples && ((int32_t)(cyclecount - SampleDue) >= 0)) {
+            Sample();
+        }
+        if (Counting && (PC < ROMsize)) {
             ProfileCounts[PC]++;
         }
         Trace(3, RidPC, PC, PC + 1);
@@ -382,10 +829,11 @@ uint32_t VMstep(uint32_t IR, int Paused) {  // EXPORTED
         }
 #ifdef TRACEABLE
         uint32_t time;
-        OpCounter[opcode]++;
+        if (Counting) OpCounter[opcode]++;
         New = 1;  // first state change in an opcode
         if (!Paused) {
             cyclecount += 1;
+            if (Bigrams && Counting) CountNgrams(opcode, slot);
         }
 #endif // TRACEABLE
         switch (opcode) {
@@ -397,6 +845,7 @@ uint32_t VMstep(uint32_t IR, int Paused) {  // EXPORTED
                 Trace(New, RidPC, PC, M);  New=0;
                 if (!Paused) {
                     cyclecount += 3;    // PC change flushes pipeline
+                    if (Timeline) TimelineEvent(TimelineExit, M, RP & (RAMsize-1));
                 }
 #endif // TRACEABLE
                 // PC is a cell address. The return stack works in bytes.
@@ -413,9 +862,13 @@ uint32_t VMstep(uint32_t IR, int Paused) {  // EXPORTED
 			case opSKIP: goto ex;					    break;	// no:
 			case opUSER: M = UserFunction (T, N, IMM);          // user
 #ifdef TRACEABLE
+                if (Timeline && !Paused) TimelineEvent(TimelineUser, IMM, T);
                 Trace(New, RidT, T, M);  New=0;
+                if (vmUserParm != N) {
+                    Trace(0, RidN, N, vmUserParm);
+                }
 #endif // TRACEABLE
-                T = M;  goto ex;
+                T = M;  N = vmUserParm;  goto ex;   // fused math returns N too
 #ifndef HostFunction
 // Host operations are available on platforms that support them.
 // They are not traceable, so don't try.
@@ -523,6 +976,7 @@ uint32_t VMstep(uint32_t IR, int Paused) {  // EXPORTED
                 Trace(0, RidPC, PC, IMM);  PC = IMM;
                 if (!Paused) {
                     cyclecount += 3;
+                    if (Timeline) TimelineEvent(TimelineCall, PC, RP & (RAMsize-1));
                 }
                 goto ex;
 #else
@@ -610,6 +1064,11 @@ uint32_t VMstep(uint32_t IR, int Paused) {  // EXPORTED
                 M = (T>>2) & (RAMsize-1);
 #ifdef TRACEABLE
                 Trace(New, RidRP, RP, M);  New=0;
+                if (!Paused) {
+                    StackKnown |= 2;
+                    if (MemStats) Extent(Stacks->rp, M);
+                    if (Timeline) TimelineEvent(TimelineRP, M, 0);
+                }
 #endif // TRACEABLE
 			    RP = M;  SDROP();                       break;	// rp!
 			case opFetch:  /* ( a -- n ) */
@@ -637,6 +1096,10 @@ GetPointer:     M = T + (M - RAMsize)*4; // common for rp, sp, up
                 M = (T>>2) & (RAMsize-1);
 #ifdef TRACEABLE
                 Trace(New, RidSP, SP, M);  New=0;
+                if (!Paused) {
+                    StackKnown |= 1;
+                    if (MemStats) Extent(Stacks->sp, M);
+                }
 #endif // TRACEABLE
                 // SP! does not post-drop
 			    SP = M;         	                    break;	// sp!
@@ -665,6 +1128,10 @@ GetPointer:     M = T + (M - RAMsize)*4; // common for rp, sp, up
                 M = (T>>2) & (RAMsize-1);
 #ifdef TRACEABLE
                 Trace(New, RidUP, UP, M);  New=0;
+                if (!Paused) {
+                    TaskSwitch(M);
+                    if (Timeline) TimelineEvent(TimelineTask, M, 0);
+                }
 #endif // TRACEABLE
 			    UP = M;  SDROP();	                    break;	// up!
 			case opRfetch: SDUP();
@@ -678,10 +1145,41 @@ GetPointer:     M = T + (M - RAMsize)*4; // common for rp, sp, up
                 Trace(New, RidT, T, ~T);  New=0;
 #endif // TRACEABLE
 			    T = ~T;                                 break;	// com
-			default:                           		    break;	//
+			default:
+#ifdef TRACEABLE
+                if (Xops[opcode]) {             // experimental opcode
+                    struct vmXop *x = Xops[opcode];
+                    uint32_t cy = CARRY;
+                    M = x->fn(T, N, &cy);
+                    x->count++;
+                    if (!Paused) {
+                        cyclecount += x->extra;
+                    }
+                    if (x->effect < 0) SNIP();
+                    if (x->effect > 0) SDUP();
+                    Trace(New, RidT, T, M);  New=0;
+                    T = M;
+                    Trace(0, RidCY, CARRY, cy);     // after the first change
+                    CARRY = cy;
+                }
+#endif // TRACEABLE
+                break;
 		}
 	} while (slot>=0);
 ex:
+#ifdef TRACEABLE
+    Watching = 0;
+    FlashTimed = 0;
+    if (!Paused) {
+        if (Counting && (group < ROMsize)) {
+            ProfileCycles[group] += cyclecount - start;
+        }
+        if (Bigrams && Counting && (slot < 32)) GroupEnds[(26 - slot) / 6][opcode]++;
+        vmIOtick(cyclecount - start);   // peripherals run alongside
+        if (SliceCycles) TimeSlice();
+        if (IRQpending) Interrupt();
+    }
+#endif // TRACEABLE
 #ifdef EmbeddedROM
     if (PC >= (SPIflashBlocks<<10)) {
         exception = -9;                 // Invalid memory address
@@ -702,6 +1200,18 @@ ex:
     return PC;
 }
 
+// enable or disable interrupts, returns the previous setting as a flag
+uint32_t VMinterrupts(uint32_t enable) {  // EXPORTED
+    uint32_t old = IntEnable ? -1 : 0;
+    IntEnable = (enable != 0);
+    return old;
+}
+
+// raise an error interrupt from outside the VM, such as a user function
+void VMexception(int ior) {  // EXPORTED
+    exception = ior;
+}
+
 // write to the debug mailbox
 void SetDbgReg(uint32_t n) {  // EXPORTED
     DebugReg = n;
@@ -22,6 +22,10 @@ uint8_t  FetchByte(int32_t addr);
 void StoreCell (uint32_t x, int32_t addr);
 void StoreHalf (uint16_t x, int32_t addr);
 void StoreByte (uint8_t x,  int32_t addr);
+int FetchBlock (uint32_t *dest, int32_t addr, int cells);   // RAM to buffer, ior
+int StoreBlock (const uint32_t *src, int32_t addr, int cells); // and back
+void VMexception(int ior);                  // error interrupt after this step
+uint32_t VMinterrupts(uint32_t enable);     // enable or disable, returns old
 
 // Different host and target behaviors:
 // Host: Writes to ROM image, looking for non-blank violations.
@@ -29,19 +33,98 @@ void StoreByte (uint8_t x,  int32_t addr);
 // Target: Triggers an error interrupt if writing to bad address space.
 //     0 to ROMsize-1 is unwritable.
 int WriteROM(uint32_t data, uint32_t address);
+int ProgramROM(const uint32_t *src, uint32_t address, int cells);
 
 // Defined in vm.c, used for development only. Not on the target system.
 void Trace(unsigned int Type, int32_t ID, uint32_t Old, uint32_t New);
 void UnTrace(int32_t ID, uint32_t old);
+extern int Tracing;                         // accessvm.c, TRUE if recording
+int SetWatch(int32_t addr, uint32_t bytes, int type); // 1=read, 2=write, ior
+void ClearWatches(void);
+extern uint32_t WatchAddr;                  // address of last watchpoint hit
+extern int WatchType;                       // 0=none, 1=read, 2=write
 extern int tiffIOR;                         // error detected when not 0
+extern int ROMchanged;                      // set by writes to ROM or flash
 extern uint32_t ROMsize;
 extern uint32_t RAMsize;
 extern uint32_t SPIflashBlocks;
 extern uint32_t cyclecount;                 // elapsed clock cycles in hardware
 extern uint32_t maxRPtime;                  // max cycles between RP! occurrences
 extern uint32_t * ProfileCounts;            // profiler data
+extern uint32_t * ProfileCycles;            // cycles per ROM group
 extern uint32_t OpCounter[64];              // dynamic instruction count
 
+// Time-slice interrupt and cycle accounting per task, if TRACEABLE.
+// A task is identified by its UP. It gets the CPU when UP! selects it.
+// A slice runs from one UP! to the next. A switch is an UP! to another task.
+// Slice lengths are binned 4 per octave, about 19% wide.
+#define SliceBins 128
+struct vmTask {
+    uint32_t up;                            // task ID, cell address in RAM
+    uint32_t cycles;                        // cycles spent running
+    uint32_t slices;                        // number of times it got the CPU
+    uint32_t switches;                      // times it gave it to another task
+    uint32_t stopped;                       // cyclecount when it lost the CPU
+    uint32_t maxWait;                       // worst wait for the CPU
+    uint32_t maxSlice;                      // longest slice
+    uint32_t hist[SliceBins];               // histogram of slice lengths
+    uint32_t sp[2], rp[2];                  // lowest, highest SP and RP cell
+};
+void VMtimeslice(uint32_t cycles);          // interrupt period, 0 = off
+void TaskUpdate(void);                      // charge the running task so far
+void TaskStatsClear(void);                  // start a new measurement
+uint32_t SlicePercentile(struct vmTask *t, int percent);   // from histogram
+extern struct vmTask Tasks[MaxTasks];
+extern int TaskCount;
+
+// Memory use, if TRACEABLE and MemStats. Stack extents are RAM cell indexes, kept per task
+// from the task's first SP! or RP! after it gets the CPU. Untracked has the
+// extents from before the first UP! and of tasks beyond MaxTasks.
+// Touched has a bit for each RAM cell the VM has read or written.
+void MemStatsClear(void);                   // start a new measurement
+void MemStatsOn(int on);                    // start (with a clear) or stop
+extern int MemStats;
+extern struct vmTask Untracked;
+extern uint32_t Touched[MaxRAMsize/32];
+extern uint32_t SliceCycles;                // cycles between interrupts
+extern uint32_t SliceCount;                 // interrupts taken
+extern uint32_t maxSliceLatency;            // worst cycles held off
+
+// Interrupt controller, if TRACEABLE. Line 0 is the time slice and has the
+// highest priority. Line n vectors to cell IRQbase+n.
+struct vmIRQ {
+    uint32_t taken;                         // interrupts taken
+    uint32_t merged;                        // raised again while pending
+    uint32_t maxLatency;                    // worst cycles from raise to entry
+    uint64_t latency;                       // total, for the average
+};
+int VMirq(int line, uint32_t ago);          // raise, ago = cycles since event
+void VMeoi(void);                           // end of interrupt
+extern uint32_t IRQpending;                 // raised but not taken yet
+extern uint32_t IRQenable;                  // mask, 1 = enabled
+extern uint32_t IRQinService;               // taken, waiting for VMeoi
+extern uint32_t IRQbase;                    // vector table
+extern uint32_t IRQlatency;                 // cycles, last interrupt
+extern struct vmIRQ IRQstats[IRQlines];
+
+// Sampling profiler, if TRACEABLE. Samples are pairs of the PC of a group
+// (cell address) and the top of the return stack (byte address), taken every
+// SamplePeriod cycles. It replaces OpCounter and ProfileCounts while it runs.
+void VMsampling(uint32_t cycles);           // period, 0 = off and counting on
+extern uint32_t SampleCycles;               // requested period
+extern uint32_t SamplePeriod;               // doubles when the buffer fills
+extern uint32_t * Samples;                  // PC, return address pairs
+extern uint32_t SampleCount;                // pairs in Samples
+
+// Opcode n-grams and slot occupancy, if TRACEABLE. Index 0 of the n-gram
+// tables counts sequences within a group, 1 those that span groups.
+// A sequence spans groups if a group starts anywhere after its first opcode.
+void NgramsOn(int on);                      // clear, start or stop counting
+extern uint32_t * Bigrams;                  // [2][64*64], NULL if off
+extern uint32_t * Trigrams;                 // [2][64*64*64]
+extern uint32_t SlotOps[6][64];             // opcodes executed per slot
+extern uint32_t GroupEnds[6][64];           // last opcode of a group, by slot
+
 //================================================================================
 
 #define opNOP        (000)  // nop
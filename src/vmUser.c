@@ -2,16 +2,28 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <sys/time.h>
+#include "vm.h"
+#include "vmUser.h"
 #include "vmConsole.h"
 #include "flash.h"
+#include "xop.h"
 
 // To facilitate FPGA/ASIC implementation, console I/O uses a peripheral bus.
 // There is no need for a 32-bit data bus, 16-bit is fine. Upper half is the address.
 // Even addresses are reads, odd are writes (or write+read)
 
-static uint32_t vmIO (uint32_t dout) {
-    unsigned int address = dout >> 16;      // typically a 4-bit address
-    uint32_t data = dout & 0xFFFF;          // and 16-bit data
+// Each bus address maps to the peripheral that registered it, so dispatch is
+// a table lookup however many devices there are. The console is built in.
+// Other devices, such as the stand-ins in periph.c or shared objects, take
+// over addresses with vmIOregister. Devices with a tick function are called
+// after each instruction group with the cycles it took.
+
+static struct vmPeripheral * IOmap[IOaddresses];
+static struct vmPeripheral * Tickers[MaxPeripherals];
+static int TickerCount;
+static int IOready;                     // console is registered
+
+static uint32_t ConsoleIO (void *ctx, unsigned int address, uint32_t data) {
     switch (address) {
         case 0: return vmQkey(data);        // 0: # of keyboard chars waiting in buffer
         case 1: return vmEmit(data);        // 1: write char to UART
@@ -26,6 +38,58 @@ static uint32_t vmIO (uint32_t dout) {
     return 0;
 }
 
+static struct vmPeripheral Console = {
+    "console", 0, 11, ConsoleIO, ConsoleIO, NULL, NULL
+};
+
+static int Mapped (struct vmPeripheral *p) {   // still owns an address
+    for (unsigned int i = 0; i < p->size; i++) {
+        if (IOmap[p->base + i] == p) return 1;
+    }
+    return 0;
+}
+
+int vmIOregister (struct vmPeripheral *p) {
+    if (!IOready) {
+        IOready = 1;
+        vmIOregister(&Console);
+    }
+    if ((p->base + p->size) > IOaddresses) return -9;
+    if (p->tick && (TickerCount == MaxPeripherals)) return -9;
+    for (unsigned int i = 0; i < p->size; i++) {
+        IOmap[p->base + i] = p;
+    }
+    int n = 0;                          // a device that lost all of its
+    for (int i = 0; i < TickerCount; i++) { // addresses stops ticking
+        if (Mapped(Tickers[i]) && (Tickers[i] != p)) Tickers[n++] = Tickers[i];
+    }
+    TickerCount = n;
+    if (p->tick) Tickers[TickerCount++] = p;
+    return 0;
+}
+
+struct vmPeripheral * vmIOdevice (unsigned int address) {
+    if (address >= IOaddresses) return NULL;
+    if (!IOready) vmIOregister(&Console);
+    return IOmap[address];
+}
+
+void vmIOtick (uint32_t cycles) {
+    for (int i = 0; i < TickerCount; i++) {
+        Tickers[i]->tick(Tickers[i]->ctx, cycles);
+    }
+}
+
+static uint32_t vmIO (uint32_t dout) {
+    unsigned int address = dout >> 16;      // 9-bit address and write bit
+    uint32_t data = dout & 0xFFFF;          // and 16-bit data
+    struct vmPeripheral *p = vmIOdevice(address);
+    if (p == NULL) return 0;
+    vmIOfn fn = (address & 1) ? p->write : p->read;
+    if (fn == NULL) return 0;
+    return fn(p->ctx, address - p->base, data);
+}
+
 uint32_t vmUserParm = 0;        // global
 
 /**
@@ -49,6 +113,28 @@ static uint32_t Bye(uint32_t dummy) {
     exit(10);  return 0;
 }
 
+static uint32_t Interrupts(uint32_t enable) {  // flag -- oldflag
+    return VMinterrupts(enable);
+}
+
+// Name of an experimental opcode, for SEE: ( c-addr opcode -- c-addr len )
+// len is 0 if the opcode isn't experimental.
+
+static uint32_t OpcodeName(uint32_t opcode) {
+#ifdef TRACEABLE
+    char *s = XopName(opcode);
+    uint32_t len = 0;
+    if (s == NULL) return 0;
+    while (s[len]) {
+        StoreByte(s[len], vmUserParm + len);
+        len++;
+    }
+    return len;
+#else
+    return 0;
+#endif // TRACEABLE
+}
+
 static uint32_t yo, divisor;
 
 static uint32_t SetDiv (uint32_t parm) {
@@ -75,15 +161,119 @@ static uint32_t Divide (uint32_t parm) {
     return quotient;
 }
 
-// replaces as@ and as!
-static uint32_t setBurstLength (uint32_t parm) {
-    return 0;
+// Fused math takes both operands from N and T and returns both results.
+// The second result goes back to N through vmUserParm. Divisors are staged
+// by SetDiv first, so `3 user drop` precedes the three-operand words.
+// Overflow and division by zero return a quotient of -1 and a remainder of 0.
+
+static uint32_t UMstar (uint32_t parm) {       // u1 u2 -- ud
+    uint64_t x = (uint64_t)parm * (uint64_t)vmUserParm;
+    vmUserParm = (uint32_t)x;
+    return (uint32_t)(x >> 32);
 }
-static uint32_t burstfetch (uint32_t parm) {
-    return 0;
+
+static uint32_t Mstar (uint32_t parm) {        // n1 n2 -- d
+    int64_t x = (int64_t)(int32_t)parm * (int64_t)(int32_t)vmUserParm;
+    vmUserParm = (uint32_t)x;
+    return (uint32_t)((uint64_t)x >> 32);
 }
-static uint32_t burststore (uint32_t parm) {
-    return 0;
+
+static uint32_t UMslashMod (uint32_t parm) {   // ud -- ur uq
+    uint64_t x = ((uint64_t)parm << 32) + vmUserParm;
+    if (parm < divisor) {
+        vmUserParm = x % divisor;
+        return x / divisor;
+    }
+    vmUserParm = 0;
+    return ~0;
+}
+
+static uint32_t Quotient (int64_t x, int floored) {
+    int64_t d = (int32_t)divisor;
+    if ((d == 0) || ((x == INT64_MIN) && (d == -1))) {
+        vmUserParm = 0;
+        return ~0;
+    }
+    int64_t q = x / d;
+    int64_t r = x % d;
+    if (floored && r && ((r ^ d) < 0)) {
+        q--;  r += d;
+    }
+    if ((q < INT32_MIN) || (q > INT32_MAX)) {
+        vmUserParm = 0;
+        return ~0;
+    }
+    vmUserParm = (uint32_t)r;
+    return (uint32_t)q;
+}
+
+static uint32_t SMslashRem (uint32_t parm) {   // d -- rem quot
+    return Quotient((int64_t)(((uint64_t)parm << 32) + vmUserParm), 0);
+}
+
+static uint32_t StarSlashMod (uint32_t parm) { // n1 n2 -- rem quot
+    int64_t x = (int64_t)(int32_t)parm * (int64_t)(int32_t)vmUserParm;
+    return Quotient(x, 1);                     // floored, like m/mod
+}
+
+// AXI space, replaces as@ and as!
+// AXI is byte addressed from 0, backed by AXIsize cells allocated on first use.
+// A burst moves BurstLength+1 cells between RAM and AXI in one step, with N
+// the RAM address and T the AXI address. Both come back advanced past the
+// the burst so that consecutive bursts stream through a buffer.
+// Each burst costs AXIlatency clock cycles plus one per cell. A burst with a
+// bad address on either side moves nothing and isn't counted.
+// Undo restores the RAM that burstfetch wrote, but not AXI: the trace only
+// has registers and RAM cells.
+
+uint32_t AXIsize = AXIsizeDefault;      // cells
+uint32_t AXIbursts, AXIcells;           // traffic since last STATS
+static uint32_t * AXI;
+static uint32_t BurstLength;            // cells less 1, as in BLEN_O
+
+void AXIbye (void) {
+    free(AXI);  AXI = NULL;
+}
+
+static uint32_t * AXIblock (uint32_t addr, int cells) {
+    if (AXI == NULL) {
+        AXI = (uint32_t*) calloc(AXIsize, sizeof(uint32_t));
+    }
+    if ((AXI == NULL) || (addr & 3) || (((addr >> 2) + cells) > AXIsize)) {
+        VMexception(-9);                // invalid memory address
+        return NULL;
+    }
+    return &AXI[addr >> 2];
+}
+
+static void AXIburst (int cells) {      // count a burst that moved data
+    AXIbursts++;  AXIcells += cells;
+#ifdef TRACEABLE
+    cyclecount += AXIlatency + cells;
+#endif // TRACEABLE
+}
+
+static uint32_t setBurstLength (uint32_t parm) {   // n -- n
+    BurstLength = parm & 0xFF;
+    return parm;
+}
+static uint32_t burstfetch (uint32_t parm) {       // ram axi -- ram' axi'
+    int cells = BurstLength + 1;
+    uint32_t * p = AXIblock(parm, cells);
+    if (p == NULL) return parm;
+    if (StoreBlock(p, vmUserParm, cells)) return parm;
+    AXIburst(cells);
+    vmUserParm += cells * 4;
+    return parm + cells * 4;
+}
+static uint32_t burststore (uint32_t parm) {       // ram axi -- ram' axi'
+    int cells = BurstLength + 1;
+    uint32_t * p = AXIblock(parm, cells);
+    if (p == NULL) return parm;
+    if (FetchBlock(p, vmUserParm, cells)) return parm;
+    AXIburst(cells);
+    vmUserParm += cells * 4;
+    return parm + cells * 4;
 }
 
 
@@ -91,7 +281,9 @@ uint32_t UserFunction (uint32_t T, uint32_t N, int fn ) {
     vmUserParm = N;
     static uint32_t (* const pf[])(uint32_t) = {
         vmIO, Bye, Counter, SetDiv, Divide, Multiply,
-        NULL, setBurstLength, burstfetch, burststore
+        NULL, setBurstLength, burstfetch, burststore,
+        UMstar, Mstar, UMslashMod, SMslashRem, StarSlashMod, Interrupts,
+        OpcodeName
 // add your own here...
     };
     if (fn < sizeof(pf) / sizeof(*pf)) {
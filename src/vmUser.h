@@ -3,8 +3,34 @@
 //==============================================================================
 #ifndef __VMUSER_H__
 #define __VMUSER_H__
+#include <stdint.h>
 
 uint32_t UserFunction (uint32_t T, uint32_t N, int fn );
 extern uint32_t vmUserParm;
 
+// AXI space model used by the burst functions
+void AXIbye (void);                     // free the AXI backing store
+extern uint32_t AXIsize;                // cells
+extern uint32_t AXIbursts, AXIcells;    // traffic since last STATS
+
+// Peripherals on the vmIO bus. A device owns size bus addresses from base.
+// Even addresses call read, odd addresses call write. Both return data.
+// Registering takes the addresses over from any previous owner. An owner
+// left with no addresses is dropped, so its tick function isn't called.
+// Only the vmIO bus is mapped. AXI bursts go to the AXI model in vmUser.c.
+#define IOaddresses     1024            /* 9-bit address and the write bit */
+#define MaxPeripherals  64              /* devices with a tick function */
+
+typedef uint32_t (*vmIOfn)(void *ctx, unsigned int reg, uint32_t data);
+struct vmPeripheral {
+    char * name;
+    unsigned int base, size;            // bus addresses
+    vmIOfn read, write;
+    void (*tick)(void *ctx, uint32_t cycles);  // optional, after each group
+    void * ctx;                         // device state
+};
+int vmIOregister (struct vmPeripheral *p);          // 0 or -9 if no room
+struct vmPeripheral * vmIOdevice (unsigned int address);   // NULL if none
+void vmIOtick (uint32_t cycles);        // called by VMstep if TRACEABLE
+
 #endif // __VMUSER_H__
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "vm.h"
+#include "compile.h"
+#include "xop.h"
+
+// ISA extension sandbox: experimental opcodes in the unused opcode slots.
+// Defining one adds an implicit-opcode header, so code compiled afterwards
+// uses the new opcode. core.f only defines its Forth versions of the
+// candidates below if they are still undefined, so "xop or" before loading
+// it puts the opcode in the whole system. Run a workload with and without an
+// opcode to compare cycle counts and ROM size exactly. .XOPS estimates both
+// from one run, using the cost of the inline Forth sequence each use replaces.
+
+struct vmXop * Xops[64];
+
+static const uint8_t FreeOpcodes[] = {
+    005, 006, 007, 013, 020, 030, 032, 042, 052, 053, 055, 062, 063, 076
+};
+
+static int IsFree(int opcode) {
+    for (int i = 0; i < (int)sizeof(FreeOpcodes); i++) {
+        if (FreeOpcodes[i] == opcode) return 1;
+    }
+    return 0;
+}
+
+int XopDefine(int opcode, struct vmXop *x) {  /*EXPORT*/
+    for (int i = 0; i < 64; i++) {
+        if (Xops[i] == x) return i;     // already defined
+    }
+    if (opcode < 0) {                   // take the next free slot
+        for (int i = 0; i < (int)sizeof(FreeOpcodes); i++) {
+            if (Xops[FreeOpcodes[i]] == NULL) {
+                opcode = FreeOpcodes[i];
+                break;
+            }
+        }
+        if (opcode < 0) return -8;      // dictionary overflow
+    }
+    if (!IsFree(opcode)) return -4;     // not an unused opcode
+    if ((x->effect < -1) || (x->effect > 1)) return -24; // invalid argument
+#ifdef TRACEABLE
+    Xops[opcode] = x;
+    AddImplicit(opcode, x->name);
+    return opcode;
+#else
+    return -21;                         // VMstep only runs them if TRACEABLE
+#endif // TRACEABLE
+}
+
+char * XopName(unsigned int opcode) {  /*EXPORT*/
+    struct vmXop *x = Xops[opcode & 0x3F];
+    return x ? x->name : NULL;
+}
+
+// Candidates that core.f synthesizes from other opcodes. They leave carry
+// as the Forth versions do, since u< and d- depend on it.
+
+static uint32_t xOr (uint32_t T, uint32_t N, uint32_t *cy) {
+    (void)cy;
+    return N | T;
+}
+static uint32_t xMinus (uint32_t T, uint32_t N, uint32_t *cy) {
+    uint64_t DX = (uint64_t)N + (uint32_t)-T;   // carry as in invert 1+ +
+    *cy = (uint32_t)(DX >> 32);
+    return (uint32_t)DX;
+}
+static uint32_t xNip (uint32_t T, uint32_t N, uint32_t *cy) {
+    (void)N; (void)cy;
+    return T;
+}
+static uint32_t xNegate (uint32_t T, uint32_t N, uint32_t *cy) {
+    (void)N; (void)cy;
+    return -T;
+}
+static uint32_t xOneMinus (uint32_t T, uint32_t N, uint32_t *cy) {
+    (void)N; (void)cy;
+    return T - 1;
+}
+static uint32_t xEqual (uint32_t T, uint32_t N, uint32_t *cy) {
+    (void)cy;
+    return (N == T) ? -1 : 0;
+}
+static uint32_t xNotEqual (uint32_t T, uint32_t N, uint32_t *cy) {
+    (void)cy;
+    return (N != T) ? -1 : 0;
+}
+static uint32_t xZeroNE (uint32_t T, uint32_t N, uint32_t *cy) {
+    (void)N; (void)cy;
+    return T ? -1 : 0;
+}
+
+static struct vmXop Candidates[] = {
+//    name     handler    effect extra slots cycles count
+    { "or",     xOr,        -1,  0,  5,  5,  0 },  // invert swap invert and invert
+    { "-",      xMinus,     -1,  0,  3,  3,  0 },  // invert 1+ +
+    { "nip",    xNip,       -1,  0,  2,  2,  0 },  // swap drop
+    { "negate", xNegate,     0,  0,  2,  2,  0 },  // invert 1+
+    { "1-",     xOneMinus,   0,  0,  3,  3,  0 },  // invert 1+ invert
+    { "=",      xEqual,     -1,  0,  2,  2,  0 },  // xor 0=
+    { "<>",     xNotEqual,  -1,  0,  3,  3,  0 },  // xor 0= 0=
+    { "0<>",    xZeroNE,     0,  0,  2,  2,  0 },  // 0= 0=
+};
+
+int XopCandidate(char *name) {  /*EXPORT*/
+    for (int i = 0; i < (int)(sizeof(Candidates) / sizeof(*Candidates)); i++) {
+        if (strcmp(Candidates[i].name, name) == 0) {
+            return XopDefine(-1, &Candidates[i]);
+        }
+    }
+    printf("\nCandidates are:");
+    for (int i = 0; i < (int)(sizeof(Candidates) / sizeof(*Candidates)); i++) {
+        printf(" %s", Candidates[i].name);
+    }
+    return -13;                         // undefined word
+}
+
+// Slots saved is per static use, cycles saved is per execution. Both assume
+// each use replaces the inline sequence.
+
+void ListXops(void) {  /*EXPORT*/
+    int64_t slots = 0;
+    int64_t cycles = 0;
+    printf("\n\"Opcode\",\"Name\",\"Static\",\"Dynamic\",\"Slots\",\"Cycles\"");
+    for (int i = 0; i < 64; i++) {
+        struct vmXop *x = Xops[i];
+        if (x == NULL) continue;
+        int64_t s = (int64_t)OpcodeCount[i] * (x->slots - 1);
+        int64_t c = (int64_t)x->count * (x->cycles - 1 - x->extra);
+        printf("\n\"%02o\",\"%s\",%u,%u,%lld,%lld", i, x->name,
+               OpcodeCount[i], x->count, (long long)s, (long long)c);
+        slots += s;  cycles += c;
+        x->count = 0;
+    }
+    printf("\n\"Total\",,,,%lld,%lld", (long long)slots, (long long)cycles);
+}
@@ -0,0 +1,29 @@
+//===============================================================================
+// xop.h
+//===============================================================================
+#ifndef __XOP_H__
+#define __XOP_H__
+#include <stdint.h>
+
+// An experimental opcode occupies an unused opcode slot. Its handler returns
+// the new T given T and N, and may change the carry flag through cy.
+// effect is the change in stack depth: -1 consumes N (like +), 0 replaces T
+// (like invert) and 1 pushes (like over).
+// slots and cycles describe the Forth code it replaces, for the .XOPS report.
+struct vmXop {
+    char * name;                        // Forth name, also used by SEE
+    uint32_t (*fn)(uint32_t T, uint32_t N, uint32_t *cy);
+    int effect;                         // -1, 0 or 1
+    int extra;                          // cycles beyond the slot's one
+    int slots, cycles;                  // cost of the Forth version per use
+    uint32_t count;                     // times executed
+};
+
+extern struct vmXop * Xops[64];         // NULL if not experimental
+
+int XopDefine(int opcode, struct vmXop *x);  // -1 = next free; opcode or ior
+int XopCandidate(char *name);           // define from the built-in list
+char * XopName(unsigned int opcode);    // NULL if not experimental
+void ListXops(void);                    // report the cycle and size delta
+
+#endif // __XOP_H__
@@ -6,6 +6,7 @@
 // Test vectors for the VM, generated by stepping the VM one group at a time,
 // starting at address 0.
 // Command in Tiff is "N make ../templates/testbench.c ../testbench/test.c".
+// Binary vectors for long runs are made by "N vectors ../testbench/test.tv".
 
 // Test vectors are embedded in a function
 // Register IDs: 0 to 5 = T, N, RP, SP, UP, PC
@@ -71,11 +72,74 @@ void changes(int Reg, uint32_t actual){
 	previous = actual;
 };
 
-int main()
+// Binary test vectors are made in Tiff by "N vectors <filename>".
+// "test file" plays them back instead of the vectors compiled in below.
+// "test file out.vhd" expands them to VHDL newstep/changes text instead.
+
+static uint32_t GetLE32(FILE *fp) {     // little-endian binary cell
+    uint32_t x = 0;
+    for (int i=0; i<4; i++) {
+        x |= (uint32_t)(fgetc(fp) & 0xFF) << (8*i);
+    }
+    return x;
+}
+
+int PlayVectors(char *infile, char *outfile) {
+    char magic[4];
+    FILE *ifp = fopen(infile, "rb");
+    if (ifp == NULL) {
+        printf("Can't open %s\n", infile);
+        return 1;
+    }
+    if ((fread(magic, 1, 4, ifp) != 4) || memcmp(magic, "TVEC", 4)) {
+        printf("%s is not a test vector file\n", infile);
+        fclose(ifp);
+        return 1;
+    }
+    FILE *ofp = NULL;
+    if (outfile) {
+        ofp = fopen(outfile, "w");
+        if (ofp == NULL) {
+            printf("Can't create %s\n", outfile);
+            fclose(ifp);
+            return 1;
+        }
+    }
+    uint32_t length = GetLE32(ifp);
+    for (uint32_t i=0; i<length; i++) {
+        uint32_t ir = GetLE32(ifp);
+        int mask = fgetc(ifp);
+        if (mask == EOF) {
+            printf("Test vector file ends early at test %u\n", i);
+            break;
+        }
+        if (ofp) fprintf(ofp, "    newstep(x\"%08X\", %u);\n", ir, i);
+        else newstep(ir, i);
+        for (int reg=0; reg<6; reg++) {
+            if (mask & (1<<reg)) {
+                uint32_t x = GetLE32(ifp);
+                if (ofp) fprintf(ofp, "    changes(%d, x\"%08X\");\n", reg, x);
+                else changes(reg, x);
+            }
+        }
+    }
+    fclose(ifp);
+    if (ofp) fclose(ofp);
+    return 0;
+}
+
+int main(int argc, char *argv[])
 {
 	VMpor();
 	RegChangeInit();
 
+    if (argc > 1) {
+        if (PlayVectors(argv[1], (argc > 2) ? argv[2] : NULL)) return 1;
+        if (argc > 2) return 0;
+        newstep(0, -1);
+        printf("\n%d tests, %d errors\n", tests-1, errors);
+        return (errors != 0);
+    }
 //           INS_GROUP  Test#
 `20`    newstep(0, -1);  // make sure last group has all changes listed.
 